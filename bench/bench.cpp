@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "base64.hpp"
+#include "base64_cache.hpp"
+#include "base64_parallel.hpp"
+
+using namespace base64;
+
+/* Runs f repeatedly for about 200ms, returns throughput in MB/s of input */
+static double throughput( unsigned size, const std::function<void()> &f )
+{
+	typedef std::chrono::steady_clock clock;
+	unsigned long long iterations = 0;
+	auto start = clock::now();
+	auto deadline = start + std::chrono::milliseconds( 200 );
+	clock::time_point now;
+	do
+	{
+		for( unsigned i = 0; i < 16; i++ )
+		{
+			f();
+		}
+		iterations += 16;
+		now = clock::now();
+	} while( now < deadline );
+	double seconds = std::chrono::duration<double>( now - start ).count();
+	return (double)size * iterations / seconds / ( 1024 * 1024 );
+}
+
+/* Returns p50 and p99 latency of f in ns per call, measured over batches of calls */
+static void latency( const std::function<void()> &f, double &p50, double &p99 )
+{
+	typedef std::chrono::steady_clock clock;
+	const unsigned batch = 32;
+	std::vector<double> samples( 20000 );
+	for( double &sample : samples )
+	{
+		auto start = clock::now();
+		for( unsigned i = 0; i < batch; i++ )
+		{
+			f();
+		}
+		sample = std::chrono::duration<double, std::nano>( clock::now() - start ).count() / batch;
+	}
+	std::sort( samples.begin(), samples.end() );
+	p50 = samples[samples.size() / 2];
+	p99 = samples[samples.size() * 99 / 100];
+}
+
+static volatile unsigned sink_;
+
+/* Keeps benchmarked results alive */
+static inline void sink( unsigned value );
+
+/* Runs random reads over a cache-sized working set for about 300ms (while background runs on another thread),
+   returns reads per microsecond */
+static double cache_workload( const std::vector<unsigned> &chain, const std::function<void()> &background )
+{
+	typedef std::chrono::steady_clock clock;
+	std::atomic<bool> stop( false );
+	std::thread thread;
+	if ( background )
+	{
+		thread = std::thread( [&]() {
+			while( !stop )
+			{
+				background();
+			}
+		} );
+	}
+	unsigned long long reads = 0;
+	unsigned p = 0;
+	auto start = clock::now();
+	auto deadline = start + std::chrono::milliseconds( 300 );
+	clock::time_point now;
+	do
+	{
+		for( unsigned i = 0; i < 1024; i++ )
+		{
+			p = chain[p];
+		}
+		reads += 1024;
+		now = clock::now();
+	} while( now < deadline );
+	stop = true;
+	if ( thread.joinable() )
+	{
+		thread.join();
+	}
+	sink( p );
+	return reads / std::chrono::duration<double, std::micro>( now - start ).count();
+}
+
+static inline void sink( unsigned value )
+{
+	sink_ = sink_ + value;
+}
+
+#ifndef _WIN32
+/* Splits buffer into segments of segment_size bytes */
+static std::vector<iovec> split( const char *data, size_t size, size_t segment_size )
+{
+	std::vector<iovec> result;
+	for( size_t pos = 0; pos < size; pos += segment_size )
+	{
+		iovec v = { const_cast<char*>( data + pos ), std::min( segment_size, size - pos ) };
+		result.push_back( v );
+	}
+	return result;
+}
+#endif
+
+/* Feeds 16 MB stream to parallel coders in 64 KB chunks, prints throughput by number of worker threads */
+static void parallel_bench( const std::string &data )
+{
+	const unsigned stream_size = 16 << 20, chunk_size = 64 * 1024;
+	const unsigned thread_counts[] = { 1, 2, 4, 8 };
+	std::string stream;
+	while( stream.size() < stream_size )
+	{
+		stream.append( data, 0, std::min<size_t>( data.size(), stream_size - stream.size() ) );
+	}
+	std::string encoded = encode( stream.data(), stream.size() );
+	auto feed = []( const std::string &input, const std::function<void( const char *data, unsigned size )> &write ) {
+		for( size_t pos = 0; pos < input.size(); pos += chunk_size )
+		{
+			write( input.data() + pos, std::min<size_t>( chunk_size, input.size() - pos ) );
+		}
+	};
+
+	printf( "\n%-24s", "16 MB stream, threads" );
+	for( unsigned threads : thread_counts )
+	{
+		printf( "%10u", threads );
+	}
+	printf( "\n%-24s", "ParallelEncoder" );
+	for( unsigned threads : thread_counts )
+	{
+		ParallelEncoder e( []( const char*, unsigned size ) { sink( size ); }, threads );
+		printf( "%10.1f", throughput( stream_size, [&]() {
+			feed( stream, [&e]( const char *data, unsigned size ) { e.encode( data, size ); } );
+			sink( e.finalize() );
+			e.reset();
+		} ) );
+		fflush( stdout );
+	}
+	printf( "\n%-24s", "ParallelDecoder" );
+	for( unsigned threads : thread_counts )
+	{
+		ParallelDecoder d( []( const char*, unsigned size ) { sink( size ); }, threads );
+		printf( "%10.1f", throughput( stream_size, [&]() {
+			feed( encoded, [&d]( const char *data, unsigned size ) { d.decode( data, size ); } );
+			sink( d.finalize() );
+			d.reset();
+		} ) );
+		fflush( stdout );
+	}
+	printf( "\n" );
+}
+
+int main( int argc, char **argv )
+{
+	const unsigned sizes[] = { 16, 64, 256, 4096, 65536, 1 << 20 };
+	std::string data( 1 << 20, '\0' );
+	for( unsigned i = 0; i < data.size(); i++ )
+	{
+		data[i] = (char)( i * 7919 + ( i >> 8 ) );
+	}
+	std::string hex;
+	for( unsigned i = 0; i < data.size(); i++ )
+	{
+		static const char digits[] = "0123456789abcdef";
+		hex += digits[( data[i] >> 4 ) & 0xf];
+		hex += digits[data[i] & 0xf];
+	}
+	std::vector<char> buf( encoded_size( data.size() ) * 2 );
+	EncodeCache cache( 64 * 1024 * 1024 );
+	EncodeCache no_cache( 0 );
+
+	printf( "%-24s", "MB/s" );
+	for( unsigned size : sizes )
+	{
+		printf( "%10u", size );
+	}
+	printf( "\n" );
+
+	struct Case
+	{
+		const char *name;
+		std::function<void( unsigned size, const std::string &in, const std::string &encoded )> run;
+		bool hex;
+	};
+	const Case cases[] = {
+		{ "encode", [&]( unsigned size, const std::string&, const std::string& ) {
+			sink( encode( data.data(), size ).size() );
+		}, false },
+		{ "EncodeCache (hit)", [&]( unsigned size, const std::string&, const std::string& ) {
+			sink( cache.encode( data.data(), size )->size() );
+		}, false },
+		{ "EncodeCache (miss)", [&]( unsigned size, const std::string&, const std::string& ) {
+			sink( no_cache.encode( data.data(), size )->size() );
+		}, false },
+		{ "encode_hex", [&]( unsigned size, const std::string &in, const std::string& ) {
+			sink( encode_hex( in.data(), in.size() ).size() );
+		}, true },
+		{ "Encoder::encode", [&]( unsigned size, const std::string&, const std::string& ) {
+			Encoder e;
+			sink( e.encode( data.data(), size ).size() + e.finalize().size() );
+		}, false },
+#ifndef _WIN32
+		// 1500-byte input segments, 4 KB output buffers
+		{ "Encoder::encode (iovec)", [&]( unsigned size, const std::string&, const std::string& ) {
+			std::vector<iovec> in = split( data.data(), size, 1500 ), out = split( buf.data(), encoded_size( size ), 4096 );
+			Encoder e;
+			sink( e.encode( in.data(), in.size(), out.data(), out.size() ) );
+		}, false },
+#endif
+		{ "validate", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			sink( validate( encoded.data(), encoded.size() ) );
+		}, false },
+		{ "decode", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			sink( decode( encoded.data(), encoded.size() ).size() );
+		}, false },
+		{ "decode (string)", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			std::string out;
+			sink( decode( encoded.data(), encoded.size(), out ) );
+		}, false },
+		{ "decode (buffer)", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			sink( decode( encoded.data(), encoded.size(), buf.data(), buf.size() ) );
+		}, false },
+		{ "decode_hex", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			sink( decode_hex( encoded.data(), encoded.size() ).size() );
+		}, false },
+		{ "Decoder::decode", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			Decoder d;
+			std::vector<char> out;
+			sink( d.decode( encoded.data(), encoded.size(), out ) );
+		}, false },
+#ifndef _WIN32
+		{ "Decoder::decode (iovec)", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			std::vector<iovec> in = split( encoded.data(), encoded.size(), 1500 ), out = split( buf.data(), encoded.size() / 4 * 3, 4096 );
+			Decoder d;
+			unsigned written;
+			sink( d.decode( in.data(), in.size(), out.data(), out.size(), written ) );
+		}, false },
+#endif
+	};
+
+	for( const Case &c : cases )
+	{
+		if ( argc > 1 && !strstr( c.name, argv[1] ) )
+		{
+			continue;
+		}
+		printf( "%-24s", c.name );
+		for( unsigned size : sizes )
+		{
+			std::string in = c.hex ? hex.substr( 0, size * 2 ) : data.substr( 0, size );
+			std::string encoded = encode( data.data(), size );
+			printf( "%10.1f", throughput( size, std::bind( c.run, size, std::cref( in ), std::cref( encoded ) ) ) );
+			fflush( stdout );
+		}
+		printf( "\n" );
+	}
+
+	const unsigned short_sizes[] = { 16, 24, 32, 48 };
+	printf( "\n%-24s", "ns/call p50/p99" );
+	for( unsigned size : short_sizes )
+	{
+		printf( "%14u", size );
+	}
+	printf( "\n" );
+	const Case short_cases[] = {
+		{ "encode", [&]( unsigned size, const std::string&, const std::string& ) {
+			sink( encode( data.data(), size ).size() );
+		}, false },
+		{ "encode (buffer)", [&]( unsigned size, const std::string&, const std::string& ) {
+			sink( encode( data.data(), size, buf.data(), buf.size() ) );
+		}, false },
+		{ "validate", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			sink( validate( encoded.data(), encoded.size() ) );
+		}, false },
+		{ "decode (buffer)", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			sink( decode( encoded.data(), encoded.size(), buf.data(), buf.size() ) );
+		}, false },
+		{ "decode (string)", [&]( unsigned, const std::string&, const std::string &encoded ) {
+			std::string out;
+			sink( decode( encoded.data(), encoded.size(), out ) );
+		}, false },
+	};
+	for( const Case &c : short_cases )
+	{
+		if ( argc > 1 && !strstr( c.name, argv[1] ) )
+		{
+			continue;
+		}
+		printf( "%-24s", c.name );
+		for( unsigned size : short_sizes )
+		{
+			std::string encoded = encode( data.data(), size );
+			double p50, p99;
+			latency( std::bind( c.run, size, std::cref( data ), std::cref( encoded ) ), p50, p99 );
+			printf( "%8.1f/%-5.1f", p50, p99 );
+			fflush( stdout );
+		}
+		printf( "\n" );
+	}
+
+	if ( argc == 1 || strstr( "parallel", argv[1] ) )
+	{
+		parallel_bench( data );
+	}
+
+	// Large buffers: throughput with large buffer mode off and on,
+	// and speed of a co-running workload, whose working set should stay in cache
+	if ( argc > 1 && !strstr( "large", argv[1] ) )
+	{
+		return 0;
+	}
+	const unsigned large_size = 64 << 20;
+	std::string large( large_size, '\0' );
+	for( unsigned i = 0; i < large.size(); i++ )
+	{
+		large[i] = (char)( i * 7919 + ( i >> 8 ) );
+	}
+	std::string large_encoded = encode( large.data(), large.size() );
+	std::vector<char> large_buf( large_encoded.size() );
+	std::vector<unsigned> chain( ( 2 << 20 ) / sizeof( unsigned ) );
+	for( unsigned i = 0; i < chain.size(); i++ )
+	{
+		chain[i] = i;
+	}
+	// Single random cycle (Sattolo's algorithm)
+	for( unsigned i = chain.size() - 1, seed = 1; i > 0; i-- )
+	{
+		seed = seed * 1103515245 + 12345;
+		std::swap( chain[i], chain[( seed >> 8 ) % i] );
+	}
+	printf( "\n%-24s%12s%12s%16s\n", "64 MB", "MB/s", "MB/s large", "MB/s large+THP" );
+	const Case large_cases[] = {
+		{ "encode (buffer)", [&]( unsigned, const std::string&, const std::string& ) {
+			sink( encode( large.data(), large.size(), large_buf.data(), large_buf.size() ) );
+		}, false },
+		{ "encode (string)", [&]( unsigned, const std::string&, const std::string& ) {
+			sink( encode( large.data(), large.size() ).size() );
+		}, false },
+		{ "decode (buffer)", [&]( unsigned, const std::string&, const std::string& ) {
+			sink( decode( large_encoded.data(), large_encoded.size(), large_buf.data(), large_buf.size() ) );
+		}, false },
+		{ "decode (string)", [&]( unsigned, const std::string&, const std::string& ) {
+			std::string out;
+			sink( decode( large_encoded.data(), large_encoded.size(), out ) );
+		}, false },
+	};
+	for( const Case &c : large_cases )
+	{
+		printf( "%-24s", c.name );
+		auto run = std::bind( c.run, large_size, std::cref( large ), std::cref( large_encoded ) );
+		large_buffer_mode( 0 );
+		printf( "%12.1f", throughput( large_size, run ) );
+		large_buffer_mode( 1 << 20 );
+		printf( "%12.1f", throughput( large_size, run ) );
+		large_buffer_mode( 1 << 20, true );
+		printf( "%16.1f\n", throughput( large_size, run ) );
+		fflush( stdout );
+	}
+	large_buffer_mode( 0 );
+
+	printf( "\n%-24s%12s%12s\n", "2 MB workload reads/us", "", "large" );
+	printf( "%-24s%12.1f\n", "alone", cache_workload( chain, std::function<void()>() ) );
+	for( unsigned i = 0; i < 2; i++ )
+	{
+		const Case &c = large_cases[i * 2];
+		auto run = std::bind( c.run, large_size, std::cref( large ), std::cref( large_encoded ) );
+		printf( "%-24s", ( std::string( "with " ) + c.name ).c_str() );
+		large_buffer_mode( 0 );
+		printf( "%12.1f", cache_workload( chain, run ) );
+		large_buffer_mode( 1 << 20 );
+		printf( "%12.1f\n", cache_workload( chain, run ) );
+		large_buffer_mode( 0 );
+	}
+	return 0;
+}
@@ -2,16 +2,36 @@
 
 #include <vector>
 #include <string>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+#ifdef BASE64_CXX17
+#if __cplusplus < 201703L
+#error "BASE64_CXX17 requires C++17 compiler mode"
+#endif
+#include <string_view>
+#endif
 
 namespace base64
 {
 
+/**
+ * String argument type: std::string_view in C++17 build mode (BASE64_CXX17), std::string otherwise.
+ * Library exports std::string overloads in both modes, std::string_view ones are defined inline below,
+ * so that code built with and without the define may share the same library.
+ */
+#ifdef BASE64_CXX17
+typedef std::string_view StringArg;
+#else
+typedef const std::string& StringArg;
+#endif
+
 /**
  * @brief validate Checks whether input string contains valid Base64-encoded data.
  * @param[in] data Base64-encoded string
  * @return True if input is valid Base64 string, otherwise returns false.
  */
-bool validate( const std::string &data );
+bool validate( StringArg data );
 
 /**
  * @brief validate Checks whether input buffer contains valid Base64-encoded data.
@@ -29,6 +49,16 @@ bool validate( const char *data, unsigned size );
  */
 std::string encode( const char *data, unsigned size );
 
+/**
+ * @brief encode Encodes input binary data into caller-supplied buffer.
+ * @param[in] data Binary data buffer
+ * @param[in] size Input data length
+ * @param[out] out Output buffer (encoded_size( size ) bytes are sufficient)
+ * @param[in] out_size Output buffer size
+ * @return number of characters written, or 0 if output buffer is too small
+ */
+unsigned encode( const char *data, unsigned size, char *out, unsigned out_size );
+
 /**
  * @brief encode_hex Encodes input hex string into Base64 string.
  * @param[in] data Hex string buffer
@@ -37,12 +67,22 @@ std::string encode( const char *data, unsigned size );
  */
 std::string encode_hex( const char *data, unsigned size );
 
+/**
+ * @brief encode_hex Encodes input hex string into caller-supplied buffer.
+ * @param[in] data Hex string buffer
+ * @param[in] size Hex string length (must be even)
+ * @param[out] out Output buffer (encoded_size( size / 2 ) bytes are sufficient)
+ * @param[in] out_size Output buffer size
+ * @return number of characters written, or 0 in case of error
+ */
+unsigned encode_hex( const char *data, unsigned size, char *out, unsigned out_size );
+
 /**
  * @brief decode Decodes input Base64 string to binary data.
  * @param[in] data Base64-encoded string
  * @return Decoded binary data, or empty vector if error occurred
  */
-std::vector<char> decode( const std::string &data );
+std::vector<char> decode( StringArg data );
 
 /**
  * @brief decode Decodes input Base64 string to binary data.
@@ -52,12 +92,48 @@ std::vector<char> decode( const std::string &data );
  */
 std::vector<char> decode( const char *data, unsigned size );
 
+/**
+ * @brief decode Decodes input Base64 string to binary data.
+ * @param[in] data Base64-encoded string
+ * @param[out] out Decoded binary data (previous content is replaced)
+ * @return true, if decoding is successful
+ */
+bool decode( StringArg data, std::string &out );
+
+/**
+ * @brief decode Decodes input Base64 string to binary data.
+ * @param[in] data Base64-encoded string
+ * @param[in] size Base64-encoded string length
+ * @param[out] out Decoded binary data (previous content is replaced)
+ * @return true, if decoding is successful
+ */
+bool decode( const char *data, unsigned size, std::string &out );
+
+/**
+ * @brief decode Decodes input Base64 string into caller-supplied buffer.
+ * @param[in] data Base64-encoded string
+ * @param[out] out Output buffer (decoded_size( data ) bytes are sufficient)
+ * @param[in] out_size Output buffer size
+ * @return number of bytes written, or 0 if error occurred or output buffer is too small
+ */
+unsigned decode( StringArg data, char *out, unsigned out_size );
+
+/**
+ * @brief decode Decodes input Base64 string into caller-supplied buffer.
+ * @param[in] data Base64-encoded string
+ * @param[in] size Base64-encoded string length
+ * @param[out] out Output buffer (decoded_size( data, size ) bytes are sufficient)
+ * @param[in] out_size Output buffer size
+ * @return number of bytes written, or 0 if error occurred or output buffer is too small
+ */
+unsigned decode( const char *data, unsigned size, char *out, unsigned out_size );
+
 /**
  * @brief decode_hex Decodes input Base64 string to hex string.
  * @param[in] data Base64-encoded string
  * @return Decoded hex string, or empty vector if error occurred
  */
-std::vector<char> decode_hex( const std::string &data );
+std::vector<char> decode_hex( StringArg data );
 
 /**
  * @brief decode_hex Decodes input Base64 string to hex string.
@@ -67,6 +143,45 @@ std::vector<char> decode_hex( const std::string &data );
  */
 std::vector<char> decode_hex( const char *data, unsigned size );
 
+/**
+ * @brief decode_hex Decodes input Base64 string to hex string.
+ * @param[in] data Base64-encoded string
+ * @param[out] out Decoded hex string (previous content is replaced)
+ * @return true, if decoding is successful
+ */
+bool decode_hex( StringArg data, std::string &out );
+
+/**
+ * @brief decode_hex Decodes input Base64 string to hex string.
+ * @param[in] data Base64-encoded string
+ * @param[in] size Base64-encoded string length
+ * @param[out] out Decoded hex string (previous content is replaced)
+ * @return true, if decoding is successful
+ */
+bool decode_hex( const char *data, unsigned size, std::string &out );
+
+/**
+ * @brief decode_hex Decodes input Base64 string to hex string in caller-supplied buffer.
+ * @param[in] data Base64-encoded string
+ * @param[in] size Base64-encoded string length
+ * @param[out] out Output buffer (2 * decoded_size( data, size ) bytes are sufficient)
+ * @param[in] out_size Output buffer size
+ * @return number of characters written, or 0 if error occurred or output buffer is too small
+ */
+unsigned decode_hex( const char *data, unsigned size, char *out, unsigned out_size );
+
+/**
+ * @brief large_buffer_mode Configures large buffer mode of encode() and decode() (binary data, x86 with SSSE3).
+ * Inputs of at least threshold bytes are processed with software prefetch and non-temporal stores,
+ * so that output doesn't evict the working set of the process from CPU caches.
+ * Cache bypass applies to caller-supplied output buffers only: std::string and std::vector outputs
+ * are zero-filled on resize. Optionally, such outputs for large inputs use transparent huge pages (Linux).
+ * Setting is global and may be changed at any time.
+ * @param[in] threshold Minimum input size (0 - large buffer mode disabled, default)
+ * @param[in] huge_pages Advise transparent huge pages for output containers
+ */
+void large_buffer_mode( unsigned threshold, bool huge_pages = false );
+
 /**
  * @brief encoded_size Returns size (in bytes) of Base64-encoded buffer.
  * @param[in] size raw(decoded) data size
@@ -79,7 +194,7 @@ unsigned encoded_size( unsigned size );
  * @param[in] encoded Base64-encoded data
  * @return data size required for decoded Base64 data, or 0 if bad data specified
  */
-unsigned decoded_size( const std::string &encoded );
+unsigned decoded_size( StringArg encoded );
 
 /**
  * @brief decoded_size Returns size (in bytes) of Base64 decoded buffer.
@@ -89,6 +204,93 @@ unsigned decoded_size( const std::string &encoded );
  */
 unsigned decoded_size( const char *encoded, unsigned size );
 
+#ifdef BASE64_CXX17
+inline bool validate( StringArg data )
+{
+	return validate( data.data(), data.size() );
+}
+
+inline std::vector<char> decode( StringArg data )
+{
+	return decode( data.data(), data.size() );
+}
+
+inline bool decode( StringArg data, std::string &out )
+{
+	return decode( data.data(), data.size(), out );
+}
+
+inline unsigned decode( StringArg data, char *out, unsigned out_size )
+{
+	return decode( data.data(), data.size(), out, out_size );
+}
+
+inline std::vector<char> decode_hex( StringArg data )
+{
+	return decode_hex( data.data(), data.size() );
+}
+
+inline bool decode_hex( StringArg data, std::string &out )
+{
+	return decode_hex( data.data(), data.size(), out );
+}
+
+inline unsigned decoded_size( StringArg encoded )
+{
+	return decoded_size( encoded.data(), encoded.size() );
+}
+#endif
+
+/**
+ * Base64 span found by scanners.
+ * Input offsets are relative to the scanned buffer, output offsets - to the arena.
+ */
+struct Span
+{
+	unsigned begin;         // first Base64 character
+	unsigned end;           // past the last Base64 character (including padding)
+	unsigned mime_begin;    // MIME type of data: URI (empty for other scanners)
+	unsigned mime_end;
+	unsigned out_begin;     // decoded data
+	unsigned out_end;
+};
+
+/**
+ * @brief scan_data_uris Finds "data:<mime>[;params];base64,<data>" URIs and decodes them into arena.
+ * Each character is read once: data is decoded while its end is searched.
+ * URIs with invalid data are skipped.
+ * @param[in] data Document (HTML, CSS, etc.)
+ * @param[in] size Document length
+ * @param[in,out] arena Decoded data is appended to arena
+ * @param[in,out] spans Found spans are appended to spans
+ * @return number of spans found
+ */
+unsigned scan_data_uris( const char *data, unsigned size, std::vector<char> &arena, std::vector<Span> &spans );
+
+/**
+ * @brief scan_prefixed Finds Base64 data following prefix and decodes it into arena.
+ * Data ends at the first character, which is not Base64 (or after padding).
+ * @param[in] data Document
+ * @param[in] size Document length
+ * @param[in] prefix Non-empty string preceding Base64 data
+ * @param[in,out] arena Decoded data is appended to arena
+ * @param[in,out] spans Found spans are appended to spans
+ * @return number of spans found
+ */
+unsigned scan_prefixed( const char *data, unsigned size, const char *prefix, std::vector<char> &arena, std::vector<Span> &spans );
+
+/**
+ * @brief scan_json Finds JSON string values, which consist of Base64 data only, and decodes them into arena.
+ * Object keys, strings with escape sequences and strings shorter than min_size are skipped.
+ * @param[in] data JSON document
+ * @param[in] size Document length
+ * @param[in,out] arena Decoded data is appended to arena
+ * @param[in,out] spans Found spans are appended to spans
+ * @param[in] min_size Minimum length of Base64 string
+ * @return number of spans found
+ */
+unsigned scan_json( const char *data, unsigned size, std::vector<char> &arena, std::vector<Span> &spans, unsigned min_size = 16 );
+
 
 /**
  * Encoder class for chunked encoding
@@ -131,11 +333,35 @@ public:
 	 */
 	std::string finalize();
 
+#ifndef _WIN32
+	/**
+	 * @brief encode Encodes scatter-gather data chunk to Base64.
+	 * Output buffers of encoded_size( total input length ) bytes are always sufficient.
+	 * @param[in] iov Input data segments
+	 * @param[in] iovcnt Number of input segments
+	 * @param[in] out Output buffers
+	 * @param[in] outcnt Number of output buffers
+	 * @return number of characters written to output buffers, or 0 if output buffers are too small
+	 */
+	unsigned encode( const iovec *iov, int iovcnt, const iovec *out, int outcnt );
+
+	/**
+	 * @brief finalize Finalize encoding (encode leftover) into output buffers.
+	 * @param[in] out Output buffers (4 bytes are always sufficient)
+	 * @param[in] outcnt Number of output buffers
+	 * @return number of characters written to output buffers, or 0 if output buffers are too small
+	 */
+	unsigned finalize( const iovec *out, int outcnt );
+#endif
+
 private:
 	bool status_;
 	unsigned encoded_bytes_;
 	unsigned n_;
 	char chunk_[3];
+
+	template<typename Format>
+	std::string encode_( const char *data, unsigned size );
 };
 
 
@@ -182,13 +408,30 @@ public:
 	 */
 	bool decode_hex( const char *data, unsigned size, std::vector<char> &out );
 
+#ifndef _WIN32
+	/**
+	 * @brief decode Decodes scatter-gather Base64 chunk to bytes.
+	 * Output buffers of ( total input length + 3 ) / 4 * 3 bytes are always sufficient.
+	 * @param[in] iov Base64-encoded data segments
+	 * @param[in] iovcnt Number of input segments
+	 * @param[in] out Output buffers
+	 * @param[in] outcnt Number of output buffers
+	 * @param[out] written Number of bytes written to output buffers
+	 * @return true, if decoding is successful (false if output buffers are too small)
+	 */
+	bool decode( const iovec *iov, int iovcnt, const iovec *out, int outcnt, unsigned &written );
+#endif
+
 private:
 	bool status_;
 	bool done_;
 	unsigned n_;
 	char chunk_[4];
 
-	bool decode_( const char *data, unsigned size, std::vector<char> &out, unsigned n, void (*append)( std::vector<char>&, char ) );
+	bool next_( const char *data, unsigned size, unsigned &pos, char bytes[3], unsigned &len );
+
+	template<typename Format>
+	bool decode_( const char *data, unsigned size, std::vector<char> &out );
 };
 
 }; // base64
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "base64.hpp"
+
+namespace base64
+{
+
+class EncodeCacheShard;
+
+/**
+ * Bounded cache of encoded buffers for repeatedly encoded payloads (certificates, icons, etc.).
+ * Entries are keyed by input hash and compared in full on lookup.
+ * Cache is split into independently locked shards, each with its own memory limit and CLOCK eviction.
+ * Thread-safe.
+ */
+class EncodeCache
+{
+public:
+	typedef std::shared_ptr<const std::string> Buffer;
+
+	struct Stats
+	{
+		unsigned long long hits;
+		unsigned long long misses;
+		unsigned long long evictions;
+		size_t entries;
+		size_t memory;
+	};
+
+	/**
+	 * @param[in] max_memory Memory limit for inputs and encoded buffers (split evenly between shards).
+	 * Inputs larger than one shard limit are encoded, but not cached.
+	 * @param[in] shards Number of shards (0 - 16)
+	 */
+	explicit EncodeCache( size_t max_memory = 64 * 1024 * 1024, unsigned shards = 0 );
+	~EncodeCache();
+
+	/**
+	 * @brief encode Returns cached Base64 encoding of data, encodes and caches data on miss.
+	 * Returned buffer stays valid after eviction.
+	 * @param[in] data Data to encode
+	 * @param[in] size Data length
+	 * @return Base64-encoded string
+	 */
+	Buffer encode( const char *data, unsigned size );
+
+	/**
+	 * @brief stats Returns counters summed over all shards.
+	 */
+	Stats stats() const;
+
+	/**
+	 * @brief clear Removes all entries. Counters are kept.
+	 */
+	void clear();
+
+private:
+	std::unique_ptr<EncodeCacheShard[]> shards_;
+	unsigned shard_count_;
+};
+
+}; // base64
@@ -0,0 +1,500 @@
+#pragma once
+
+/*
+ * C++20 coroutine interface: asynchronous encoding and decoding of chunked streams.
+ * Header-only, available when compiling with -std=c++20 (or later).
+ */
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "base64.hpp"
+
+namespace base64
+{
+
+template<typename T>
+struct AsyncResult
+{
+	std::optional<T> value;
+
+	void return_value( T v )
+	{
+		value.emplace( std::move( v ) );
+	}
+
+	T result()
+	{
+		return std::move( *value );
+	}
+};
+
+template<>
+struct AsyncResult<void>
+{
+	void return_void()
+	{
+	}
+
+	void result()
+	{
+	}
+};
+
+
+/**
+ * Lazily started coroutine returning T.
+ * Awaiting the task starts it, awaiting coroutine is resumed when the task completes.
+ */
+template<typename T = void>
+class AsyncTask
+{
+public:
+	struct promise_type : AsyncResult<T>
+	{
+		std::coroutine_handle<> continuation = std::noop_coroutine();
+		std::exception_ptr exception;
+
+		AsyncTask get_return_object()
+		{
+			return AsyncTask( std::coroutine_handle<promise_type>::from_promise( *this ) );
+		}
+
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		auto final_suspend() noexcept
+		{
+			struct Awaiter
+			{
+				bool await_ready() noexcept
+				{
+					return false;
+				}
+
+				std::coroutine_handle<> await_suspend( std::coroutine_handle<promise_type> h ) noexcept
+				{
+					return h.promise().continuation;
+				}
+
+				void await_resume() noexcept
+				{
+				}
+			};
+			return Awaiter();
+		}
+
+		void unhandled_exception()
+		{
+			exception = std::current_exception();
+		}
+	};
+
+	AsyncTask( AsyncTask &&other ) noexcept :
+		handle_( std::exchange( other.handle_, nullptr ) )
+	{
+	}
+
+	AsyncTask( const AsyncTask& ) = delete;
+	AsyncTask& operator=( const AsyncTask& ) = delete;
+
+	~AsyncTask()
+	{
+		if ( handle_ )
+		{
+			handle_.destroy();
+		}
+	}
+
+	auto operator co_await() && noexcept
+	{
+		struct Awaiter
+		{
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() noexcept
+			{
+				return handle.done();
+			}
+
+			std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+			{
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+
+			T await_resume()
+			{
+				return AsyncTask::result_( handle );
+			}
+		};
+		return Awaiter{ handle_ };
+	}
+
+private:
+	friend class AsyncLoop;
+
+	std::coroutine_handle<promise_type> handle_;
+
+	explicit AsyncTask( std::coroutine_handle<promise_type> handle ) :
+		handle_( handle )
+	{
+	}
+
+	static T result_( std::coroutine_handle<promise_type> handle )
+	{
+		if ( handle.promise().exception )
+		{
+			std::rethrow_exception( handle.promise().exception );
+		}
+		return handle.promise().result();
+	}
+};
+
+
+/**
+ * Asynchronous generator of T values.
+ * co_await next() resumes the generator and returns pointer to the next value (nullptr at the end).
+ * The value is valid until the generator is resumed again.
+ */
+template<typename T>
+class AsyncGenerator
+{
+public:
+	struct promise_type
+	{
+		const T *value = nullptr;
+		std::coroutine_handle<> consumer = std::noop_coroutine();
+		std::exception_ptr exception;
+
+		struct YieldAwaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			std::coroutine_handle<> await_suspend( std::coroutine_handle<promise_type> h ) noexcept
+			{
+				return h.promise().consumer;
+			}
+
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		AsyncGenerator get_return_object()
+		{
+			return AsyncGenerator( std::coroutine_handle<promise_type>::from_promise( *this ) );
+		}
+
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		YieldAwaiter final_suspend() noexcept
+		{
+			value = nullptr;
+			return {};
+		}
+
+		// Value lives in the generator frame (until the end of co_yield expression)
+		YieldAwaiter yield_value( const T &v ) noexcept
+		{
+			value = std::addressof( v );
+			return {};
+		}
+
+		void return_void() noexcept
+		{
+		}
+
+		void unhandled_exception()
+		{
+			exception = std::current_exception();
+		}
+	};
+
+	AsyncGenerator( AsyncGenerator &&other ) noexcept :
+		handle_( std::exchange( other.handle_, nullptr ) )
+	{
+	}
+
+	AsyncGenerator( const AsyncGenerator& ) = delete;
+	AsyncGenerator& operator=( const AsyncGenerator& ) = delete;
+
+	~AsyncGenerator()
+	{
+		if ( handle_ )
+		{
+			handle_.destroy();
+		}
+	}
+
+	auto next() noexcept
+	{
+		struct Awaiter
+		{
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() noexcept
+			{
+				return handle.done();
+			}
+
+			std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+			{
+				handle.promise().consumer = awaiting;
+				return handle;
+			}
+
+			const T *await_resume()
+			{
+				if ( handle.promise().exception )
+				{
+					std::rethrow_exception( std::exchange( handle.promise().exception, nullptr ) );
+				}
+				return handle.done() ? nullptr : handle.promise().value;
+			}
+		};
+		return Awaiter{ handle_ };
+	}
+
+private:
+	std::coroutine_handle<promise_type> handle_;
+
+	explicit AsyncGenerator( std::coroutine_handle<promise_type> handle ) :
+		handle_( handle )
+	{
+	}
+};
+
+
+/**
+ * Minimal single-threaded executor: a queue of suspended coroutines resumed by run().
+ */
+class AsyncLoop
+{
+public:
+	/**
+	 * @brief schedule Returns awaitable, which suspends the coroutine and queues it for resumption.
+	 */
+	auto schedule() noexcept
+	{
+		struct Awaiter
+		{
+			AsyncLoop &loop;
+
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			void await_suspend( std::coroutine_handle<> h )
+			{
+				loop.queue_.push_back( h );
+			}
+
+			void await_resume() noexcept
+			{
+			}
+		};
+		return Awaiter{ *this };
+	}
+
+	/**
+	 * @brief run Starts the task and resumes queued coroutines until the task completes.
+	 * Task must not wait for events outside of the loop.
+	 * @return task result
+	 */
+	template<typename T>
+	T run( AsyncTask<T> task )
+	{
+		task.handle_.resume();
+		while( !task.handle_.done() && !queue_.empty() )
+		{
+			std::coroutine_handle<> h = queue_.front();
+			queue_.pop_front();
+			h.resume();
+		}
+		return AsyncTask<T>::result_( task.handle_ );
+	}
+
+private:
+	std::deque<std::coroutine_handle<>> queue_;
+};
+
+
+/**
+ * @brief encode_async Encodes data chunks from asynchronous source.
+ * Whole triplets are encoded with the bulk encoder straight into a single output block,
+ * which is reused for the whole stream.
+ * @param[in] source Callable, co_await source() returns std::string_view with the next chunk (empty at the end)
+ * @param[in] block_size Maximum size of yielded blocks, rounded down to multiple of 4
+ * @return generator of encoded blocks (at least one per input chunk with complete triplets)
+ */
+template<typename Source>
+AsyncGenerator<std::string_view> encode_async( Source source, unsigned block_size = 64 * 1024 )
+{
+	std::vector<char> out( std::max( block_size / 4, 1u ) * 4 );
+	char chunk[3];
+	unsigned n = 0;
+	while( true )
+	{
+		std::string_view in = co_await source();
+		if ( in.empty() )
+		{
+			break;
+		}
+		const char *data = in.data();
+		size_t size = in.size();
+		unsigned pos = 0;
+		if ( n )
+		{
+			// Complete triplet started by previous chunk
+			for( ; n < 3 && size; n++, size--, data++ )
+			{
+				chunk[n] = *data;
+			}
+			if ( n < 3 )
+			{
+				continue;
+			}
+			pos = encode( chunk, 3, out.data(), out.size() );
+			n = 0;
+		}
+		while( size >= 3 )
+		{
+			unsigned len = std::min<size_t>( size / 3 * 3, ( out.size() - pos ) / 4 * 3 );
+			pos += encode( data, len, out.data() + pos, out.size() - pos );
+			data += len;
+			size -= len;
+			if ( out.size() - pos < 4 )
+			{
+				co_yield std::string_view( out.data(), pos );
+				pos = 0;
+			}
+		}
+		for( ; size; size--, data++ )
+		{
+			chunk[n++] = *data;
+		}
+		if ( pos )
+		{
+			co_yield std::string_view( out.data(), pos );
+		}
+	}
+	if ( n )
+	{
+		co_yield std::string_view( out.data(), encode( chunk, n, out.data(), out.size() ) );
+	}
+}
+
+/**
+ * @brief decode_async Decodes Base64 chunks from asynchronous source.
+ * Whole groups are decoded with the bulk decoder straight into a single output block,
+ * which is reused for the whole stream.
+ * @param[in] source Callable, co_await source() returns std::string_view with the next chunk (empty at the end)
+ * @param[out] status Set to false, if input is invalid or incomplete (generator stops at the first error).
+ * Must outlive the generator.
+ * @param[in] block_size Maximum size of yielded blocks, rounded down to multiple of 3
+ * @return generator of decoded blocks
+ */
+template<typename Source>
+AsyncGenerator<std::string_view> decode_async( Source source, bool &status, unsigned block_size = 64 * 1024 )
+{
+	std::vector<char> out( std::max( block_size / 3, 1u ) * 3 );
+	char group[4];
+	unsigned n = 0;
+	bool padded = false;
+	status = true;
+	while( true )
+	{
+		std::string_view in = co_await source();
+		if ( in.empty() )
+		{
+			break;
+		}
+		const char *data = in.data();
+		size_t size = in.size();
+		unsigned pos = 0;
+		if ( padded )
+		{
+			status = false;
+			co_return;
+		}
+		if ( n )
+		{
+			// Complete group started by previous chunk
+			for( ; n < 4 && size; n++, size--, data++ )
+			{
+				group[n] = *data;
+			}
+			if ( n < 4 )
+			{
+				continue;
+			}
+			pos = decode( group, 4, out.data(), out.size() );
+			if ( !pos )
+			{
+				status = false;
+				co_return;
+			}
+			padded = pos < 3;
+			n = 0;
+		}
+		while( size >= 4 )
+		{
+			// Block may be already filled by the group completed above
+			if ( out.size() - pos < 3 )
+			{
+				co_yield std::string_view( out.data(), pos );
+				pos = 0;
+			}
+			// Only padding may end the stream
+			unsigned len = std::min<size_t>( size / 4 * 4, ( out.size() - pos ) / 3 * 4 );
+			unsigned written = padded ? 0 : decode( data, len, out.data() + pos, out.size() - pos );
+			if ( !written )
+			{
+				status = false;
+				co_return;
+			}
+			padded = written < len / 4 * 3;
+			pos += written;
+			data += len;
+			size -= len;
+		}
+		if ( size && padded )
+		{
+			status = false;
+			co_return;
+		}
+		for( ; size; size--, data++ )
+		{
+			group[n++] = *data;
+		}
+		if ( pos )
+		{
+			co_yield std::string_view( out.data(), pos );
+		}
+	}
+	if ( n )
+	{
+		status = false;
+	}
+}
+
+}; // base64
+
+#endif
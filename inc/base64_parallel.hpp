@@ -0,0 +1,117 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include "base64.hpp"
+
+namespace base64
+{
+
+class ParallelCodec;
+
+/**
+ * Output callback for parallel coders.
+ * Called from the thread feeding the coder, in original stream order.
+ */
+typedef std::function<void( const char *data, unsigned size )> ParallelOutput;
+
+
+/**
+ * Parallel encoder for a single long-lived stream.
+ * Input is split into blocks (multiple of 3 bytes), which are encoded by worker threads
+ * and passed to the output callback in the original order.
+ */
+class ParallelEncoder
+{
+public:
+	/**
+	 * @param[in] output Output callback
+	 * @param[in] threads Number of worker threads (0 - number of hardware threads)
+	 * @param[in] block_size Input block size, rounded down to multiple of 3
+	 * @param[in] queue_depth Maximum number of blocks in flight (0 - twice the number of threads).
+	 * encode() blocks when this limit is reached.
+	 */
+	explicit ParallelEncoder( ParallelOutput output, unsigned threads = 0, unsigned block_size = 256 * 1024, unsigned queue_depth = 0 );
+	~ParallelEncoder();
+
+	/**
+	 * @brief operator bool Returns true, if encoding is successful.
+	 */
+	operator bool() const;
+
+	/**
+	 * @brief reset Waits for blocks in flight (discarding their output) and clears object state.
+	 * @return object reference
+	 */
+	ParallelEncoder& reset();
+
+	/**
+	 * @brief encode Queues data chunk for encoding.
+	 * Output of completed blocks is passed to the output callback.
+	 * @param[in] data Data to encode
+	 * @param[in] size Data length
+	 * @return true, if encoding is successful
+	 */
+	bool encode( const char *data, unsigned size );
+
+	/**
+	 * @brief finalize Encodes leftover and waits until all output is passed to the output callback.
+	 * @return true, if encoding is successful
+	 */
+	bool finalize();
+
+private:
+	std::unique_ptr<ParallelCodec> codec_;
+};
+
+
+/**
+ * Parallel decoder for a single long-lived stream.
+ * Input is split into blocks (multiple of 4 characters), which are decoded by worker threads
+ * and passed to the output callback in the original order.
+ */
+class ParallelDecoder
+{
+public:
+	/**
+	 * @param[in] output Output callback
+	 * @param[in] threads Number of worker threads (0 - number of hardware threads)
+	 * @param[in] block_size Input block size, rounded down to multiple of 4
+	 * @param[in] queue_depth Maximum number of blocks in flight (0 - twice the number of threads).
+	 * decode() blocks when this limit is reached.
+	 */
+	explicit ParallelDecoder( ParallelOutput output, unsigned threads = 0, unsigned block_size = 256 * 1024, unsigned queue_depth = 0 );
+	~ParallelDecoder();
+
+	/**
+	 * @brief operator bool Returns true, if decoding is successful.
+	 */
+	operator bool() const;
+
+	/**
+	 * @brief reset Waits for blocks in flight (discarding their output) and clears object state.
+	 * @return object reference
+	 */
+	ParallelDecoder& reset();
+
+	/**
+	 * @brief decode Queues Base64 chunk for decoding.
+	 * Output of completed blocks is passed to the output callback.
+	 * @param[in] data Base64-encoded data
+	 * @param[in] size Base64-encoded string length
+	 * @return true, if decoding is successful
+	 */
+	bool decode( const char *data, unsigned size );
+
+	/**
+	 * @brief finalize Decodes leftover and waits until all output is passed to the output callback.
+	 * @return true, if decoding is successful and input is complete
+	 */
+	bool finalize();
+
+private:
+	std::unique_ptr<ParallelCodec> codec_;
+	bool padded_;
+};
+
+}; // base64
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "base64.hpp"
+
+namespace base64
+{
+
+class Waiter;
+
+/**
+ * Decoding pipeline between one producer thread (Base64 input) and one consumer thread (decoded data).
+ * Decoder writes directly into a fixed ring of pre-allocated slabs, the consumer reads filled slabs
+ * in place and releases them. Producer blocks while all slabs are in use, consumer - while none is ready.
+ * No allocations are made after construction. Not available on Windows (uses iovec interface of Decoder).
+ */
+#ifndef _WIN32
+class DecodePipeline
+{
+public:
+	/**
+	 * @param[in] slabs Number of slabs in the ring
+	 * @param[in] slab_size Slab capacity in bytes (at least 3)
+	 */
+	explicit DecodePipeline( unsigned slabs = 16, unsigned slab_size = 64 * 1024 );
+	~DecodePipeline();
+
+	/**
+	 * @brief operator bool Returns true, if decoding is successful (and, after finish(), input is complete).
+	 */
+	operator bool() const;
+
+	/**
+	 * @brief reset Clears object state. Must not be called while producer or consumer is active.
+	 * @return object reference
+	 */
+	DecodePipeline& reset();
+
+	/**
+	 * @brief decode Decodes Base64 chunk into slabs. Producer side.
+	 * Filled slabs are passed to the consumer, blocks while all slabs are in use.
+	 * @param[in] data Base64-encoded data
+	 * @param[in] size Base64-encoded string length
+	 * @return true, if decoding is successful
+	 */
+	bool decode( const char *data, unsigned size );
+
+	/**
+	 * @brief finish Passes the last (partially filled) slab to the consumer and ends the stream. Producer side.
+	 * @return true, if decoding is successful and input is complete
+	 */
+	bool finish();
+
+	/**
+	 * @brief acquire Waits for the next filled slab. Consumer side.
+	 * Slab stays valid until release().
+	 * @param[out] data Decoded data
+	 * @param[out] size Decoded data length
+	 * @return false, if stream is finished and all slabs are consumed
+	 */
+	bool acquire( const char *&data, unsigned &size );
+
+	/**
+	 * @brief release Returns slab obtained by acquire() to the producer. Consumer side.
+	 */
+	void release();
+
+private:
+	unsigned slab_count_;
+	unsigned slab_size_;
+	std::unique_ptr<char[]> slabs_;
+	std::unique_ptr<unsigned[]> sizes_;
+
+	// Producer state
+	Decoder decoder_;
+	unsigned fill_;
+	unsigned long long released_cache_;
+	bool padded_;
+
+	// Counters are padded apart to keep them on separate cache lines
+	char pad0_[64];
+	std::atomic<unsigned long long> published_;
+	char pad1_[64];
+	std::atomic<unsigned long long> released_;
+	char pad2_[64];
+	std::atomic<bool> finished_;
+	std::atomic<bool> status_;
+	std::unique_ptr<Waiter> waiter_;
+	char pad3_[64];
+
+	void publish_();
+};
+#endif
+
+}; // base64
@@ -1,7 +1,17 @@
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstring>
 #include "base64.hpp"
+#include "probes.hpp"
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define BASE64_SSSE3
+#include <tmmintrin.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 namespace base64
 {
@@ -28,27 +38,25 @@ static const char hex_characters_[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-static bool process_chunk( const char *&chunk, std::string &result, unsigned inc )
+static inline void encode_triplet( const char *chunk, char *out )
 {
-	result += mapping_[( chunk[0] & 0xfc ) >> 2];
-	result += mapping_[( ( chunk[0] & 0x03 ) << 4 ) + ( ( chunk[1] & 0xf0 ) >> 4 )];
-	result += mapping_[( ( chunk[1] & 0x0f ) << 2 ) + ( ( chunk[2] & 0xc0 ) >> 6 )];
-	result += mapping_[chunk[2] & 0x3f];
-	chunk += inc;
-	return true;
+	out[0] = mapping_[( chunk[0] & 0xfc ) >> 2];
+	out[1] = mapping_[( ( chunk[0] & 0x03 ) << 4 ) + ( ( chunk[1] & 0xf0 ) >> 4 )];
+	out[2] = mapping_[( ( chunk[1] & 0x0f ) << 2 ) + ( ( chunk[2] & 0xc0 ) >> 6 )];
+	out[3] = mapping_[chunk[2] & 0x3f];
 }
 
 static inline bool hex_nibble_to_byte( char ch, char &byte )
 {
-	if ( hex_characters_[(int)ch] )
+	if ( hex_characters_[(unsigned char)ch] )
 	{
-		byte |= hex_characters_[(int)ch] - 1;
+		byte |= hex_characters_[(unsigned char)ch] - 1;
 		return true;
 	}
 	return false;
 }
 
-static bool hex_byte( char hi, char lo, char &byte )
+static inline bool hex_byte( char hi, char lo, char &byte )
 {
 	byte = 0;
 	if ( !hex_nibble_to_byte( hi, byte ) )
@@ -63,44 +71,544 @@ static bool hex_byte( char hi, char lo, char &byte )
 	return true;
 }
 
-static bool process_hex_chunk( const char *&chunk, std::string &result, unsigned inc )
+/* Decodes 4 characters without padding. Returns false on padding or invalid character */
+static inline bool decode_quad( const char *in, char *bytes )
 {
-	char b1 = 0, b2 = 0, b3 = 0;
-	if ( !hex_byte( chunk[0], chunk[1], b1 ) ||
-		 ( chunk[2] && !hex_byte( chunk[2], chunk[3], b2 ) ) ||
-		 ( chunk[4] && !hex_byte( chunk[4], chunk[5], b3 ) ) )
+	unsigned char a = valid_base64_characters_[(unsigned char)in[0]];
+	unsigned char b = valid_base64_characters_[(unsigned char)in[1]];
+	unsigned char c = valid_base64_characters_[(unsigned char)in[2]];
+	unsigned char d = valid_base64_characters_[(unsigned char)in[3]];
+	if ( !a || !b || !c || !d )
 	{
 		return false;
 	}
-	result += mapping_[( b1 & 0xfc ) >> 2];
-	result += mapping_[( ( b1 & 0x03 ) << 4 ) + ( ( b2 & 0xf0 ) >> 4 )];
-	result += mapping_[( ( b2 & 0x0f ) << 2 ) + ( ( b3 & 0xc0 ) >> 6 )];
-	result += mapping_[b3 & 0x3f];
-	chunk += inc;
+	a--;
+	b--;
+	c--;
+	d--;
+	bytes[0] = ( a << 2 ) + ( ( b & 0x30 ) >> 4 );
+	bytes[1] = ( ( b & 0x0f ) << 4 ) + ( ( c & 0x3c ) >> 2 );
+	bytes[2] = ( ( c & 0x03 ) << 6 ) + d;
 	return true;
 }
 
-static inline unsigned index_by_char( char c )
+/* Decodes last 4 characters, which may be padded. Returns number of bytes, or 0 on error */
+static inline unsigned decode_last_quad( const char *in, char *bytes )
 {
-	if ( c == '=' )
+	if ( in[2] == '=' && in[3] != '=' )
+	{
+		return 0;
+	}
+	const char quad[] = { in[0], in[1], in[2] == '=' ? 'A' : in[2], in[3] == '=' ? 'A' : in[3] };
+	if ( !decode_quad( quad, bytes ) )
 	{
 		return 0;
 	}
-	auto n = valid_base64_characters_[c];
-	return ( n > 0 ) ? n - 1 : 0;
+	return ( in[2] == '=' ) ? 1 : ( in[3] == '=' ) ? 2 : 3;
 }
 
-bool validate( const std::string &data )
+/* Returns offset of the first character breaking Base64 format (size, if characters are valid). Used only on errors */
+static inline unsigned error_offset_( const char *data, unsigned size )
 {
-	return validate( data.c_str(), data.size() );
+	unsigned i = 0;
+	for( ; i < size && valid_base64_characters_[(unsigned char)data[i]]; i++ );
+	for( unsigned eq = 0; i < size && data[i] == '=' && eq < 2; i++, eq++ );
+	return i;
 }
 
-bool validate( const char *data, unsigned size )
+namespace
+{
+
+/**
+ * Binary data format: one byte per character.
+ */
+struct Binary
+{
+	static const unsigned width = 1;
+
+	static inline bool read( const char *p, char &byte )
+	{
+		byte = *p;
+		return true;
+	}
+
+	static inline char *write( char *p, char byte )
+	{
+		*p = byte;
+		return p + 1;
+	}
+};
+
+/**
+ * Hex string format: two characters per byte.
+ */
+struct Hex
+{
+	static const unsigned width = 2;
+
+	static inline bool read( const char *p, char &byte )
+	{
+		return hex_byte( p[0], p[1], byte );
+	}
+
+	static inline char *write( char *p, char byte )
+	{
+		static const char digits[] = "0123456789abcdef";
+		p[0] = digits[( byte & 0xf0 ) >> 4];
+		p[1] = digits[byte & 0x0f];
+		return p + 2;
+	}
+};
+
+} // namespace
+
+#ifdef BASE64_SSSE3
+/*
+ * Short input path: inputs of 16 to short_input_ bytes are processed by SSSE3 kernels.
+ * Last block is loaded so that it ends at the end of input and overlaps the previous one,
+ * so there is no scalar tail loop and no read past the end of input.
+ * SSSE3 support is detected at run time, other CPUs use scalar code.
+ */
+static const unsigned short_input_ = 64;
+static const unsigned short_encoded_ = ( short_input_ + 2 ) / 3 * 4;
+
+static bool detect_ssse3()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "ssse3" );
+}
+
+static const bool ssse3_ = detect_ssse3();
+
+/* Byte order of 12-byte block for encode_block_ssse3(), for block starting at offset 0 to 4 of 16-byte load */
+static const signed char encode_shuffle_[][16] = {
+	{ 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 },
+	{ 2, 1, 3, 2, 5, 4, 6, 5, 8, 7, 9, 8, 11, 10, 12, 11 },
+	{ 3, 2, 4, 3, 6, 5, 7, 6, 9, 8, 10, 9, 12, 11, 13, 12 },
+	{ 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 13, 12, 14, 13 },
+	{ 5, 4, 6, 5, 8, 7, 9, 8, 11, 10, 12, 11, 14, 13, 15, 14 }
+};
+
+/* Encodes 12 bytes (selected by shuffle) into 16 characters */
+__attribute__(( target( "ssse3" ) ))
+static inline __m128i encode_block_ssse3( __m128i in, const signed char *shuffle )
+{
+	in = _mm_shuffle_epi8( in, _mm_loadu_si128( reinterpret_cast<const __m128i*>( shuffle ) ) );
+	const __m128i t0 = _mm_and_si128( in, _mm_set1_epi32( 0x0fc0fc00 ) );
+	const __m128i t1 = _mm_mulhi_epu16( t0, _mm_set1_epi32( 0x04000040 ) );
+	const __m128i t2 = _mm_and_si128( in, _mm_set1_epi32( 0x003f03f0 ) );
+	const __m128i t3 = _mm_mullo_epi16( t2, _mm_set1_epi32( 0x01000010 ) );
+	const __m128i indices = _mm_or_si128( t1, t3 );
+	// Offset from 6-bit index to character, selected by index range
+	const __m128i shift = _mm_setr_epi8( 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0 );
+	__m128i range = _mm_subs_epu8( indices, _mm_set1_epi8( 51 ) );
+	const __m128i less = _mm_cmpgt_epi8( _mm_set1_epi8( 26 ), indices );
+	range = _mm_or_si128( range, _mm_and_si128( less, _mm_set1_epi8( 13 ) ) );
+	return _mm_add_epi8( _mm_shuffle_epi8( shift, range ), indices );
+}
+
+/* Decodes 16 characters into 12 bytes, accumulates invalid characters in error */
+__attribute__(( target( "ssse3" ) ))
+static inline __m128i decode_block_ssse3( __m128i in, __m128i &error )
+{
+	const __m128i lut_lo = _mm_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a );
+	const __m128i lut_hi = _mm_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+	const __m128i lut_roll = _mm_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+	const __m128i nibble = _mm_set1_epi8( 0x0f );
+	const __m128i hi = _mm_and_si128( _mm_srli_epi32( in, 4 ), nibble );
+	const __m128i lo = _mm_and_si128( in, nibble );
+	error = _mm_or_si128( error, _mm_and_si128( _mm_shuffle_epi8( lut_lo, lo ), _mm_shuffle_epi8( lut_hi, hi ) ) );
+	const __m128i slash = _mm_cmpeq_epi8( in, _mm_set1_epi8( '/' ) );
+	const __m128i values = _mm_add_epi8( in, _mm_shuffle_epi8( lut_roll, _mm_add_epi8( slash, hi ) ) );
+	const __m128i pairs = _mm_maddubs_epi16( values, _mm_set1_epi32( 0x01400140 ) );
+	const __m128i triplets = _mm_madd_epi16( pairs, _mm_set1_epi32( 0x00011000 ) );
+	return _mm_shuffle_epi8( triplets, _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ) );
+}
+
+__attribute__(( target( "ssse3" ) ))
+static inline bool valid_ssse3( __m128i error )
+{
+	return !_mm_movemask_epi8( _mm_cmpgt_epi8( error, _mm_setzero_si128() ) );
+}
+
+/* Stores 12 bytes of decoded block */
+__attribute__(( target( "ssse3" ) ))
+static inline void store_block_ssse3( char *out, __m128i bytes )
+{
+	_mm_storel_epi64( reinterpret_cast<__m128i*>( out ), bytes );
+	int last = _mm_cvtsi128_si32( _mm_srli_si128( bytes, 8 ) );
+	memcpy( out + 8, &last, 4 );
+}
+
+/* Encodes 16 to short_input_ bytes */
+__attribute__(( target( "ssse3" ) ))
+static void encode_short_( const char *data, unsigned size, char *out )
+{
+	const unsigned leftover = size % 3;
+	const unsigned full = size - leftover;
+	for( unsigned i = 0; i < full; i += 12 )
+	{
+		// Last block ends at the last complete triplet, and its load ends at the end of input
+		i = std::min( i, full - 12 );
+		unsigned pos = std::min( i, size - 16 );
+		__m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + pos ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( out + i / 3 * 4 ), encode_block_ssse3( block, encode_shuffle_[i - pos] ) );
+	}
+	out += full / 3 * 4;
+	if ( leftover )
+	{
+		const char chunk[] = { data[full], leftover > 1 ? data[full + 1] : '\0', '\0' };
+		encode_triplet( chunk, out );
+		out[2] = ( leftover == 1 ) ? '=' : out[2];
+		out[3] = '=';
+	}
+}
+
+/* Decodes 16 to short_encoded_ characters without padding (size is multiple of 4).
+   Returns false on invalid characters. */
+__attribute__(( target( "ssse3" ) ))
+static bool decode_short_( const char *data, unsigned size, char *out )
+{
+	__m128i error = _mm_setzero_si128();
+	for( unsigned i = 0, j = 0; i + 16 <= size; i += 16, j += 12 )
+	{
+		__m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) );
+		store_block_ssse3( out + j, decode_block_ssse3( block, error ) );
+	}
+	// Last block, loaded from the end of input
+	__m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + size - 16 ) );
+	store_block_ssse3( out + size / 4 * 3 - 12, decode_block_ssse3( block, error ) );
+	return valid_ssse3( error );
+}
+
+/* Checks 16 to short_encoded_ characters without padding */
+__attribute__(( target( "ssse3" ) ))
+static bool validate_short_( const char *data, unsigned size )
+{
+	__m128i error = _mm_setzero_si128();
+	for( unsigned i = 0; i + 16 <= size; i += 16 )
+	{
+		decode_block_ssse3( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) ), error );
+	}
+	decode_block_ssse3( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + size - 16 ) ), error );
+	return valid_ssse3( error );
+}
+
+/* Decodes up to blocks 16-character blocks (12 bytes each), stops before the first block with other characters.
+   Returns number of decoded blocks. */
+__attribute__(( target( "ssse3" ) ))
+static unsigned decode_blocks_( const char *data, unsigned blocks, char *out )
+{
+	unsigned i = 0;
+	for( ; i < blocks; i++, data += 16, out += 12 )
+	{
+		__m128i error = _mm_setzero_si128();
+		__m128i bytes = decode_block_ssse3( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data ) ), error );
+		if ( !valid_ssse3( error ) )
+		{
+			break;
+		}
+		store_block_ssse3( out, bytes );
+	}
+	return i;
+}
+
+/*
+ * Large buffer path: output is written with non-temporal stores, bypassing CPU caches,
+ * and input is prefetched with non-temporal hint, so that the caller's working set is not evicted.
+ */
+static const unsigned prefetch_distance_ = 1024;
+
+/* Encodes whole 12-byte blocks of large input into output, which starts Head (1 to 15) bytes before 16-byte boundary.
+   The first Head characters are stored as is, the rest is shifted into aligned stores.
+   Returns number of input bytes, whose output is complete (multiple of 12). */
+template<int Head>
+__attribute__(( target( "ssse3" ) ))
+static unsigned encode_large_shifted_( const char *data, unsigned size, char *out )
+{
+	if ( size < 16 )
+	{
+		return 0;
+	}
+	__m128i prev = encode_block_ssse3( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data ) ), encode_shuffle_[0] );
+	memcpy( out, &prev, Head );
+	__m128i *o = reinterpret_cast<__m128i*>( out + Head );
+	unsigned i = 12;
+	for( ; i + 16 <= size; i += 12, o++ )
+	{
+		if ( i + prefetch_distance_ < size )
+		{
+			_mm_prefetch( data + i + prefetch_distance_, _MM_HINT_NTA );
+		}
+		__m128i next = encode_block_ssse3( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) ), encode_shuffle_[0] );
+		// Last 16 - Head characters of previous block and the first Head characters of the next one
+		_mm_stream_si128( o, _mm_alignr_epi8( next, prev, Head ) );
+		prev = next;
+	}
+	_mm_sfence();
+	// Last block is written only partially
+	return i - 12;
+}
+
+/* Encodes whole 12-byte blocks of large input, returns number of input bytes processed (multiple of 3) */
+__attribute__(( target( "ssse3" ) ))
+static unsigned encode_large_( const char *data, unsigned size, char *out )
+{
+	switch( reinterpret_cast<uintptr_t>( out ) % 16 )
+	{
+	case 1: return encode_large_shifted_<15>( data, size, out );
+	case 2: return encode_large_shifted_<14>( data, size, out );
+	case 3: return encode_large_shifted_<13>( data, size, out );
+	case 4: return encode_large_shifted_<12>( data, size, out );
+	case 5: return encode_large_shifted_<11>( data, size, out );
+	case 6: return encode_large_shifted_<10>( data, size, out );
+	case 7: return encode_large_shifted_<9>( data, size, out );
+	case 8: return encode_large_shifted_<8>( data, size, out );
+	case 9: return encode_large_shifted_<7>( data, size, out );
+	case 10: return encode_large_shifted_<6>( data, size, out );
+	case 11: return encode_large_shifted_<5>( data, size, out );
+	case 12: return encode_large_shifted_<4>( data, size, out );
+	case 13: return encode_large_shifted_<3>( data, size, out );
+	case 14: return encode_large_shifted_<2>( data, size, out );
+	case 15: return encode_large_shifted_<1>( data, size, out );
+	}
+	unsigned i = 0;
+	for( ; i + 16 <= size; i += 12, out += 16 )
+	{
+		if ( i + prefetch_distance_ < size )
+		{
+			_mm_prefetch( data + i + prefetch_distance_, _MM_HINT_NTA );
+		}
+		__m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) );
+		_mm_stream_si128( reinterpret_cast<__m128i*>( out ), encode_block_ssse3( block, encode_shuffle_[0] ) );
+	}
+	_mm_sfence();
+	return i;
+}
+
+/* Decodes whole 64-character blocks of large input without padding.
+   Returns number of characters processed (multiple of 4), valid is set to false on invalid characters. */
+__attribute__(( target( "ssse3" ) ))
+static unsigned decode_large_( const char *data, unsigned size, char *out, bool &valid )
+{
+	unsigned i = 0;
+	char bytes[3];
+	valid = true;
+	// Scalar groups until output is 16-byte aligned
+	for( ; reinterpret_cast<uintptr_t>( out ) % 16 && i + 4 <= size; i += 4, out += 3 )
+	{
+		if ( !decode_quad( data + i, bytes ) )
+		{
+			valid = false;
+			return i;
+		}
+		memcpy( out, bytes, 3 );
+	}
+	__m128i error = _mm_setzero_si128();
+	for( ; i + 64 <= size; i += 64, out += 48 )
+	{
+		if ( i + prefetch_distance_ < size )
+		{
+			_mm_prefetch( data + i + prefetch_distance_, _MM_HINT_NTA );
+		}
+		const __m128i *in = reinterpret_cast<const __m128i*>( data + i );
+		__m128i b0 = decode_block_ssse3( _mm_loadu_si128( in ), error );
+		__m128i b1 = decode_block_ssse3( _mm_loadu_si128( in + 1 ), error );
+		__m128i b2 = decode_block_ssse3( _mm_loadu_si128( in + 2 ), error );
+		__m128i b3 = decode_block_ssse3( _mm_loadu_si128( in + 3 ), error );
+		// Four 12-byte blocks are packed into three 16-byte stores
+		__m128i *o = reinterpret_cast<__m128i*>( out );
+		_mm_stream_si128( o, _mm_or_si128( b0, _mm_slli_si128( b1, 12 ) ) );
+		_mm_stream_si128( o + 1, _mm_or_si128( _mm_srli_si128( b1, 4 ), _mm_slli_si128( b2, 8 ) ) );
+		_mm_stream_si128( o + 2, _mm_or_si128( _mm_srli_si128( b2, 8 ), _mm_slli_si128( b3, 4 ) ) );
+	}
+	_mm_sfence();
+	valid = valid_ssse3( error );
+	return i;
+}
+#endif
+
+// Large buffer mode settings, see large_buffer_mode()
+static std::atomic<unsigned> large_threshold_( 0 );
+static std::atomic<bool> huge_pages_( false );
+
+static inline bool large_( unsigned size )
+{
+	unsigned threshold = large_threshold_.load( std::memory_order_relaxed );
+	return threshold && size >= threshold;
+}
+
+/*
+ * Resizes output container. For large inputs, transparent huge pages are advised before resize touches the pages.
+ * Resize zero-fills the container through the cache (C++11 has no way to skip that), so that container outputs
+ * don't benefit from non-temporal stores.
+ */
+template<typename Container>
+static void resize_output_( Container &out, size_t size, unsigned input_size )
+{
+#ifdef __linux__
+	if ( large_( input_size ) && huge_pages_.load( std::memory_order_relaxed ) && out.capacity() < size )
+	{
+		const uintptr_t huge_page = 2 * 1024 * 1024;
+		out.reserve( size );
+		uintptr_t p = reinterpret_cast<uintptr_t>( out.data() );
+		uintptr_t begin = ( p + huge_page - 1 ) & ~( huge_page - 1 );
+		uintptr_t end = ( p + size ) & ~( huge_page - 1 );
+		if ( begin < end )
+		{
+			madvise( reinterpret_cast<void*>( begin ), end - begin, MADV_HUGEPAGE );
+		}
+	}
+#endif
+	out.resize( size );
+}
+
+/* Encodes size bytes of Format data into encoded_size( size ) characters */
+template<typename Format>
+static bool encode_( const char *data, unsigned size, char *out )
+{
+#ifdef BASE64_SSSE3
+	if ( Format::width == 1 && size >= 16 && size <= short_input_ && ssse3_ )
+	{
+		encode_short_( data, size, out );
+		return true;
+	}
+	if ( Format::width == 1 && large_( size ) && ssse3_ )
+	{
+		unsigned n = encode_large_( data, size, out );
+		data += n;
+		out += n / 3 * 4;
+		size -= n;
+	}
+#endif
+	char chunk[3];
+	for( ; size > 2; size -= 3, data += 3 * Format::width, out += 4 )
+	{
+		if ( !Format::read( data, chunk[0] ) ||
+			 !Format::read( data + Format::width, chunk[1] ) ||
+			 !Format::read( data + 2 * Format::width, chunk[2] ) )
+		{
+			return false;
+		}
+		encode_triplet( chunk, out );
+	}
+	if ( size )
+	{
+		chunk[1] = chunk[2] = 0;
+		for( unsigned i = 0; i < size; i++, data += Format::width )
+		{
+			if ( !Format::read( data, chunk[i] ) )
+			{
+				return false;
+			}
+		}
+		encode_triplet( chunk, out );
+		out[3] = '=';
+		if ( size == 1 )
+		{
+			out[2] = '=';
+		}
+	}
+	return true;
+}
+
+/* Decodes input into buffer, returns number of characters written or 0 on error */
+template<typename Format>
+static unsigned decode_buffer_( const char *data, unsigned size, char *out, unsigned out_size )
+{
+	// Up to 2 padding characters and no leading one, so that decoded_size() is exact
+	// (block kernels store decoded data before checking it)
+	if ( size % 4 || size == 0 || data[0] == '=' || data[size - 3] == '=' ||
+		 out_size < decoded_size( data, size ) * Format::width )
+	{
+		return 0;
+	}
+	char *p = out;
+	char bytes[3];
+	const char *last = data + size - 4;
+#ifdef BASE64_SSSE3
+	if ( Format::width == 1 && size >= 20 && size <= short_encoded_ && ssse3_ )
+	{
+		if ( !decode_short_( data, size - 4, p ) )
+		{
+			return 0;
+		}
+		p += ( size - 4 ) / 4 * 3;
+		data = last;
+	}
+	else if ( Format::width == 1 && large_( size ) && ssse3_ )
+	{
+		bool valid;
+		unsigned n = decode_large_( data, size - 4, p, valid );
+		if ( !valid )
+		{
+			return 0;
+		}
+		p += n / 4 * 3;
+		data += n;
+	}
+#endif
+	for( ; data < last; data += 4 )
+	{
+		if ( !decode_quad( data, bytes ) )
+		{
+			return 0;
+		}
+		p = Format::write( p, bytes[0] );
+		p = Format::write( p, bytes[1] );
+		p = Format::write( p, bytes[2] );
+	}
+	unsigned n = decode_last_quad( data, bytes );
+	if ( !n )
+	{
+		return 0;
+	}
+	for( unsigned i = 0; i < n; i++ )
+	{
+		p = Format::write( p, bytes[i] );
+	}
+	return p - out;
+}
+
+template<typename Format>
+static unsigned decode_( const char *data, unsigned size, char *out, unsigned out_size )
+{
+	BASE64_PROBE1( decode__entry, size );
+	unsigned n = decode_buffer_<Format>( data, size, out, out_size );
+	BASE64_PROBE4( decode__return, size, n, n != 0, n ? size : error_offset_( data, size ) );
+	return n;
+}
+
+/* Decodes input into resizable container (std::vector<char> or std::string) */
+template<typename Format, typename Container>
+static bool decode_( const char *data, unsigned size, Container &out )
+{
+	BASE64_PROBE1( decode__entry, size );
+	resize_output_( out, decoded_size( data, size ) * Format::width, size );
+	if ( !out.empty() )
+	{
+		out.resize( decode_buffer_<Format>( data, size, &out[0], out.size() ) );
+	}
+	BASE64_PROBE4( decode__return, size, out.size(), !out.empty(), out.empty() ? error_offset_( data, size ) : size );
+	return !out.empty();
+}
+
+static bool validate_( const char *data, unsigned size )
 {
 	if ( size % 4 || size == 0 )
 	{
 		return false;
 	}
+#ifdef BASE64_SSSE3
+	if ( size >= 20 && size <= short_encoded_ && ssse3_ )
+	{
+		char bytes[3];
+		return validate_short_( data, size - 4 ) && decode_last_quad( data + size - 4, bytes );
+	}
+#endif
 	unsigned i;
 	for( i = 0; i < size; i++ )
 	{
@@ -109,7 +617,7 @@ bool validate( const char *data, unsigned size )
 		{
 			break;
 		}
-		if ( valid_base64_characters_[(unsigned)ch] == 0 )
+		if ( valid_base64_characters_[(unsigned char)ch] == 0 )
 		{
 			return false;
 		}
@@ -130,127 +638,139 @@ bool validate( const char *data, unsigned size )
 			return false;
 		}
 	}
-	return data[i] == '\0';
+	return i == size;
 }
 
-static std::string encode_( const char *data, unsigned size, unsigned n, bool (*process_chunk_)( const char*&, std::string&, unsigned ) )
+bool validate( const std::string &data )
 {
+	return validate( data.data(), data.size() );
+}
+
+bool validate( const char *data, unsigned size )
+{
+	BASE64_PROBE1( validate__entry, size );
+	bool status = validate_( data, size );
+	BASE64_PROBE3( validate__return, size, status, status ? size : error_offset_( data, size ) );
+	return status;
+}
+
+std::string encode( const char *data, unsigned size )
+{
+	BASE64_PROBE1( encode__entry, size );
 	std::string result;
-	unsigned result_len = ( ( size * 8u ) / 6u ) + ( ( size * 8u ) % 6u ? 1 : 0 );
-	unsigned padding_len = ( ( result_len + 3u ) & ~3u ) - result_len;
-	result_len = ( result_len + 3u ) & ~3u;
-	result.reserve( result_len );
+	resize_output_( result, encoded_size( size ), size );
+	encode_<Binary>( data, size, &result[0] );
+	BASE64_PROBE3( encode__return, size, result.size(), true );
+	return result;
+}
 
-	const char *p = data;
-	for( ; size > 2; size -= 3 )
+unsigned encode( const char *data, unsigned size, char *out, unsigned out_size )
+{
+	BASE64_PROBE1( encode__entry, size );
+	unsigned n = encoded_size( size );
+	if ( out_size < n )
 	{
-		if ( !process_chunk_( p, result, n ) )
-		{
-			return std::string();
-		}
+		n = 0;
 	}
-	if ( size )
+	else
 	{
-		char leftover[n] = {0};
-		if ( !( n % 2 ) )
-		{
-			size *= 2;
-		}
-		for( unsigned i = 0; size > 0; size--, i++, p++ )
-		{
-			leftover[i] = *p;
-		}
-		p = leftover;
-		if ( !process_chunk_( p, result, 0 ) )
-		{
-			return std::string();
-		}
-		for( unsigned i = 0; i < padding_len; i++ )
+		encode_<Binary>( data, size, out );
+	}
+	BASE64_PROBE3( encode__return, size, n, n != 0 );
+	return n;
+}
+
+std::string encode_hex( const char *data, unsigned size )
+{
+	BASE64_PROBE1( encode__entry, size );
+	std::string result;
+	if ( size % 2 == 0 )
+	{
+		result.resize( encoded_size( size / 2 ) );
+		if ( !encode_<Hex>( data, size / 2, &result[0] ) )
 		{
-			result[result.size() - i - 1] = '=';
+			result.clear();
 		}
 	}
+	BASE64_PROBE3( encode__return, size, result.size(), !result.empty() );
 	return result;
 }
 
-std::string encode( const char *data, unsigned size )
+unsigned encode_hex( const char *data, unsigned size, char *out, unsigned out_size )
 {
-	return encode_( data, size, 3, &process_chunk );
+	BASE64_PROBE1( encode__entry, size );
+	unsigned n = encoded_size( size / 2 );
+	if ( size % 2 || out_size < n || !encode_<Hex>( data, size / 2, out ) )
+	{
+		n = 0;
+	}
+	BASE64_PROBE3( encode__return, size, n, n != 0 );
+	return n;
 }
 
-std::string encode_hex( const char *data, unsigned size )
+std::vector<char> decode( const std::string &data )
 {
-	if ( size % 2 )
-	{
-		return std::string();
-	}
-	size /= 2;
-	return encode_( data, size, 6, &process_hex_chunk );
+	return decode( data.data(), data.size() );
 }
 
-static void append( std::vector<char> &v, char ch )
+std::vector<char> decode( const char *data, unsigned size )
 {
-	v.push_back( ch );
+	std::vector<char> result;
+	decode_<Binary>( data, size, result );
+	return result;
 }
 
-static void append_hex( std::vector<char> &v, char ch )
+bool decode( const std::string &data, std::string &out )
 {
-	char tmp = ( ch & 0xf0 ) >> 4;
-	v.push_back( tmp + ( ( tmp > 9 ) ? 'a' - 10 : '0' ) );
-	tmp = ch & 0x0f;
-	v.push_back( tmp + ( ( tmp > 9 ) ? 'a' - 10 : '0' ) );
+	return decode( data.data(), data.size(), out );
 }
 
-std::vector<char> decode_( const char *data, unsigned size, unsigned n, void (*append)( std::vector<char>&, char ) )
+bool decode( const char *data, unsigned size, std::string &out )
 {
-	std::vector<char> result;
-	if ( validate( data, size ) )
-	{
-		result.reserve( decoded_size( data, size ) );
-		char buf[4];
-		for( unsigned i = 0; i < size; i += 4 )
-		{
-			char buf[] = {
-				(char)index_by_char( data[i] ),
-				(char)index_by_char( data[i+1] ),
-				(char)index_by_char( data[i+2] ),
-				(char)index_by_char( data[i+3] )
-			};
-			append( result, ( buf[0] << 2 ) + ( ( buf[1] & 0x30 ) >> 4 ) );
-			append( result, ( ( buf[1] & 0x0f ) << 4 ) + ( ( buf[2] & 0x3c ) >> 2 ) );
-			append( result, ( ( buf[2] & 0x03 ) << 6 ) + ( buf[3] & 0x3f ) );
-		}
-		unsigned eq;
-		for( eq = 0; data[size - eq - 1] == '='; eq++ );
-		switch( eq )
-		{
-		case 0:
-			break;
-		default:
-			result.resize( result.size() - eq * n );
-		}
-	}
-	return result;
+	return decode_<Binary>( data, size, out );
 }
 
-std::vector<char> decode( const std::string &data )
+unsigned decode( const std::string &data, char *out, unsigned out_size )
 {
-	return decode( data.c_str(), data.size() );
+	return decode( data.data(), data.size(), out, out_size );
 }
 
-std::vector<char> decode( const char *data, unsigned size )
+unsigned decode( const char *data, unsigned size, char *out, unsigned out_size )
 {
-	return decode_( data, size, 1, &append );
+	return decode_<Binary>( data, size, out, out_size );
 }
 
 std::vector<char> decode_hex( const std::string &data )
 {
-	return decode_hex( data.c_str(), data.size() );
+	return decode_hex( data.data(), data.size() );
 }
 
 std::vector<char> decode_hex( const char *data, unsigned size )
 {
-	return decode_( data, size, 2, &append_hex );
+	std::vector<char> result;
+	decode_<Hex>( data, size, result );
+	return result;
+}
+
+bool decode_hex( const std::string &data, std::string &out )
+{
+	return decode_hex( data.data(), data.size(), out );
+}
+
+bool decode_hex( const char *data, unsigned size, std::string &out )
+{
+	return decode_<Hex>( data, size, out );
+}
+
+unsigned decode_hex( const char *data, unsigned size, char *out, unsigned out_size )
+{
+	return decode_<Hex>( data, size, out, out_size );
+}
+
+void large_buffer_mode( unsigned threshold, bool huge_pages )
+{
+	large_threshold_ = threshold;
+	huge_pages_ = huge_pages;
 }
 
 unsigned encoded_size( unsigned size )
@@ -260,7 +780,7 @@ unsigned encoded_size( unsigned size )
 
 unsigned decoded_size( const std::string &encoded )
 {
-	return decoded_size( encoded.c_str(), encoded.size() );
+	return decoded_size( encoded.data(), encoded.size() );
 }
 
 unsigned decoded_size( const char *encoded, unsigned size )
@@ -274,6 +794,210 @@ unsigned decoded_size( const char *encoded, unsigned size )
 	return ( ( size * 3 ) / 4 ) - padding_chars;
 }
 
+/* Grows arena geometrically, so that it holds at least size bytes */
+static inline void reserve_( std::vector<char> &arena, size_t size )
+{
+	if ( arena.size() < size )
+	{
+		arena.resize( std::max<size_t>( arena.size() * 2, size + 4096 ) );
+	}
+}
+
+static inline bool is_space_( char ch )
+{
+	return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+/* Decodes Base64 run starting at data[pos] into arena at out (advanced by decoded size).
+   end is set past the run (including padding). Returns false, if run is empty or ends with a single character. */
+static bool decode_run_( const char *data, size_t size, size_t pos, std::vector<char> &arena, size_t &out, size_t &end )
+{
+	size_t i = pos;
+	char bytes[3];
+#ifdef BASE64_SSSE3
+	while( ssse3_ && size - i >= 16 )
+	{
+		unsigned blocks = std::min<size_t>( ( size - i ) / 16, 256 );
+		reserve_( arena, out + blocks * 12 );
+		unsigned n = decode_blocks_( data + i, blocks, &arena[out] );
+		i += n * 16;
+		out += n * 12;
+		if ( n < blocks )
+		{
+			break;
+		}
+	}
+#endif
+	for( ; size - i >= 4 && decode_quad( data + i, bytes ); i += 4 )
+	{
+		reserve_( arena, out + 3 );
+		memcpy( &arena[out], bytes, 3 );
+		out += 3;
+	}
+	// Last group: 2 or 3 characters, optionally padded
+	unsigned n = 0;
+	for( ; n < 3 && i + n < size && valid_base64_characters_[(unsigned char)data[i + n]]; n++ );
+	end = i + n;
+	if ( n == 1 || end == pos )
+	{
+		return false;
+	}
+	if ( n )
+	{
+		const char group[] = { data[i], data[i + 1], n == 3 ? data[i + 2] : '=', '=' };
+		unsigned len = decode_last_quad( group, bytes );
+		reserve_( arena, out + 3 );
+		memcpy( &arena[out], bytes, len );
+		out += len;
+		for( ; n < 4 && end < size && data[end] == '='; n++, end++ );
+	}
+	return true;
+}
+
+/* Returns position of the next prefix (len > 0) occurrence at or after pos, or size */
+static size_t find_( const char *data, size_t size, size_t pos, const char *prefix, size_t len )
+{
+	// Last character is searched with memchr, the rest is compared
+	for( size_t i = pos + len - 1; i < size; i++ )
+	{
+		const char *p = static_cast<const char*>( memchr( data + i, prefix[len - 1], size - i ) );
+		if ( !p )
+		{
+			break;
+		}
+		i = p - data;
+		if ( memcmp( p - ( len - 1 ), prefix, len - 1 ) == 0 )
+		{
+			return i - ( len - 1 );
+		}
+	}
+	return size;
+}
+
+/* Returns position of the closing (not escaped) quote of JSON string, searching from pos, or size */
+static size_t string_end_( const char *data, size_t size, size_t pos )
+{
+	const size_t start = pos;
+	while( const char *quote = static_cast<const char*>( memchr( data + pos, '"', size - pos ) ) )
+	{
+		size_t q = quote - data, slashes = 0;
+		for( ; q - slashes > start && data[q - slashes - 1] == '\\'; slashes++ );
+		if ( slashes % 2 == 0 )
+		{
+			return q;
+		}
+		pos = q + 1;
+	}
+	return size;
+}
+
+static inline void add_span_( std::vector<Span> &spans, size_t begin, size_t end, size_t mime_begin, size_t mime_end,
+	size_t out_begin, size_t out_end )
+{
+	Span span = { (unsigned)begin, (unsigned)end, (unsigned)mime_begin, (unsigned)mime_end,
+		(unsigned)out_begin, (unsigned)out_end };
+	spans.push_back( span );
+}
+
+unsigned scan_data_uris( const char *data, unsigned size, std::vector<char> &arena, std::vector<Span> &spans )
+{
+	static const char prefix[] = "data:";
+	static const char marker[] = ";base64";
+	size_t out = arena.size();
+	unsigned count = 0;
+	for( size_t pos = find_( data, size, 0, prefix, 5 ); pos < size; pos = find_( data, size, pos, prefix, 5 ) )
+	{
+		// Media type and parameters, ending with ";base64,"
+		size_t mime_begin = pos + 5, i = mime_begin;
+		size_t limit = std::min<size_t>( size, mime_begin + 256 );
+		for( ; i < limit && data[i] != ',' && data[i] != '"' && data[i] != '\'' && data[i] != '<' &&
+			   data[i] != '>' && data[i] != ')' && !is_space_( data[i] ); i++ );
+		pos = i;
+		if ( i == limit || data[i] != ',' || i - mime_begin < 7 || memcmp( data + i - 7, marker, 7 ) != 0 )
+		{
+			continue;
+		}
+		size_t mime_end = static_cast<const char*>( memchr( data + mime_begin, ';', i - mime_begin ) ) - data;
+		size_t begin = i + 1, out_begin = out, end;
+		if ( decode_run_( data, size, begin, arena, out, end ) )
+		{
+			add_span_( spans, begin, end, mime_begin, mime_end, out_begin, out );
+			count++;
+		}
+		else
+		{
+			out = out_begin;
+		}
+		pos = std::max( end, begin );
+	}
+	arena.resize( out );
+	return count;
+}
+
+unsigned scan_prefixed( const char *data, unsigned size, const char *prefix, std::vector<char> &arena, std::vector<Span> &spans )
+{
+	size_t len = strlen( prefix );
+	size_t out = arena.size();
+	unsigned count = 0;
+	if ( len == 0 )
+	{
+		return 0;
+	}
+	for( size_t pos = find_( data, size, 0, prefix, len ); pos < size; pos = find_( data, size, pos, prefix, len ) )
+	{
+		size_t begin = pos + len, out_begin = out, end;
+		if ( decode_run_( data, size, begin, arena, out, end ) )
+		{
+			add_span_( spans, begin, end, begin, begin, out_begin, out );
+			count++;
+		}
+		else
+		{
+			out = out_begin;
+		}
+		pos = std::max( end, begin );
+	}
+	arena.resize( out );
+	return count;
+}
+
+unsigned scan_json( const char *data, unsigned size, std::vector<char> &arena, std::vector<Span> &spans, unsigned min_size )
+{
+	size_t out = arena.size();
+	unsigned count = 0;
+	for( size_t pos = 0; pos < size; )
+	{
+		const char *quote = static_cast<const char*>( memchr( data + pos, '"', size - pos ) );
+		if ( !quote )
+		{
+			break;
+		}
+		size_t begin = quote - data + 1, out_begin = out, end;
+		if ( !decode_run_( data, size, begin, arena, out, end ) || end == size || data[end] != '"' )
+		{
+			// Not Base64: skip the rest of the string (characters before end are Base64, so no quotes or escapes)
+			out = out_begin;
+			pos = string_end_( data, size, end ) + 1;
+			continue;
+		}
+		// Object keys are followed by ':'
+		size_t next = end + 1;
+		for( ; next < size && is_space_( data[next] ); next++ );
+		if ( end - begin >= min_size && ( next == size || data[next] != ':' ) )
+		{
+			add_span_( spans, begin, end, begin, begin, out_begin, out );
+			count++;
+		}
+		else
+		{
+			out = out_begin;
+		}
+		pos = end + 1;
+	}
+	arena.resize( out );
+	return count;
+}
+
 
 Encoder::Encoder() :
 	status_( true ),
@@ -297,104 +1021,229 @@ Encoder& Encoder::reset()
 
 std::string Encoder::encode( const char *data, unsigned size )
 {
-	if ( !status_ )
-	{
-		return std::string();
-	}
-	encoded_bytes_ += size;
-	unsigned pos = 0;
-	std::string result;
-	while( true )
-	{
-		for( ; n_ < 3 && pos < size; n_++, pos++ )
-		{
-			chunk_[n_] = data[pos];
-		}
-		if ( n_ < 3 )
-		{
-			break;
-		}
-		const char *p = chunk_;
-		if ( !process_chunk( p, result, 0 ) )
-		{
-			status_ = false;
-			return std::string();
-		}
-		n_ = 0;
-	}
+	BASE64_PROBE1( encoder__encode__entry, size );
+	std::string result = encode_<Binary>( data, size );
+	BASE64_PROBE3( encoder__encode__return, size, result.size(), status_ );
 	return result;
 }
 
 std::string Encoder::encode_hex( const char *data, unsigned size )
 {
+	BASE64_PROBE1( encoder__encode__entry, size );
 	if ( size % 2 )
 	{
 		status_ = false;
 	}
+	std::string result = encode_<Hex>( data, size / 2 );
+	BASE64_PROBE3( encoder__encode__return, size, result.size(), status_ );
+	return result;
+}
+
+template<typename Format>
+std::string Encoder::encode_( const char *data, unsigned size )
+{
 	if ( !status_ )
 	{
 		return std::string();
 	}
-	encoded_bytes_ += size / 2;
-	unsigned pos = 0;
-	std::string result;
-	while( true )
+	encoded_bytes_ += size;
+	std::string result( ( ( n_ + size ) / 3 ) * 4, '\0' );
+	char *out = &result[0];
+	if ( n_ )
 	{
-		for( ; n_ < 3 && pos < size; n_++, pos += 2 )
+		for( ; n_ < 3 && size; n_++, size--, data += Format::width )
 		{
-			char byte;
-			if ( !hex_byte( data[pos], data[pos + 1], byte ) )
+			if ( !Format::read( data, chunk_[n_] ) )
 			{
 				status_ = false;
 				return std::string();
 			}
-			chunk_[n_] = byte;
 		}
 		if ( n_ < 3 )
 		{
-			break;
+			return result;
 		}
-		const char *p = chunk_;
-		if ( !process_chunk( p, result, 0 ) )
+		encode_triplet( chunk_, out );
+		out += 4;
+		n_ = 0;
+	}
+	unsigned full = size - size % 3;
+	if ( !base64::encode_<Format>( data, full, out ) )
+	{
+		status_ = false;
+		return std::string();
+	}
+	data += full * Format::width;
+	for( ; n_ < size - full; n_++, data += Format::width )
+	{
+		if ( !Format::read( data, chunk_[n_] ) )
 		{
 			status_ = false;
 			return std::string();
 		}
-		n_ = 0;
 	}
 	return result;
 }
 
 std::string Encoder::finalize()
 {
-	if ( !status_ )
-	{
-		return std::string();
-	}
+	BASE64_PROBE1( encoder__finalize__entry, encoded_bytes_ );
 	std::string result;
-	unsigned result_len = ( ( encoded_bytes_ * 8u ) / 6u ) + ( ( encoded_bytes_ * 8u ) % 6u ? 1 : 0 );
-	unsigned padding_len = ( ( result_len + 3u ) & ~3u ) - result_len;
-
-	if ( n_ )
+	if ( status_ && n_ )
 	{
 		for( unsigned i = n_; i < 3; i++ )
 		{
 			chunk_[i] = '\0';
 		}
-		const char *p = chunk_;
-		if ( !process_chunk( p, result, 0 ) )
+		result.resize( 4 );
+		encode_triplet( chunk_, &result[0] );
+		result[3] = '=';
+		if ( n_ == 1 )
 		{
-			status_ = false;
-			return std::string();
+			result[2] = '=';
+		}
+	}
+	BASE64_PROBE2( encoder__finalize__return, result.size(), status_ );
+	return result;
+}
+
+#ifndef _WIN32
+/**
+ * Writes data across a list of fixed-size output buffers.
+ */
+class IovecWriter
+{
+public:
+	IovecWriter( const iovec *iov, int iovcnt ) :
+		iov_( iov ),
+		end_( iov + ( iovcnt > 0 ? iovcnt : 0 ) ),
+		pos_( 0 ),
+		written_( 0 )
+	{
+	}
+
+	bool write( const char *data, unsigned size )
+	{
+		while( size )
+		{
+			if ( iov_ == end_ )
+			{
+				return false;
+			}
+			size_t n = std::min<size_t>( size, iov_->iov_len - pos_ );
+			memcpy( static_cast<char*>( iov_->iov_base ) + pos_, data, n );
+			pos_ += n;
+			data += n;
+			size -= n;
+			written_ += n;
+			if ( pos_ == iov_->iov_len )
+			{
+				iov_++;
+				pos_ = 0;
+			}
 		}
-		for( unsigned i = 0; i < padding_len; i++ )
+		return true;
+	}
+
+	/* Returns free space of the current output buffer (size is 0, if all buffers are full) */
+	char *buffer( size_t &size )
+	{
+		for( ; iov_ != end_ && pos_ == iov_->iov_len; iov_++, pos_ = 0 );
+		if ( iov_ == end_ )
 		{
-			result[result.size() - i - 1] = '=';
+			size = 0;
+			return nullptr;
 		}
+		size = iov_->iov_len - pos_;
+		return static_cast<char*>( iov_->iov_base ) + pos_;
 	}
-	return result;
+
+	/* Accounts size bytes written directly into buffer() */
+	void advance( size_t size )
+	{
+		pos_ += size;
+		written_ += size;
+	}
+
+	unsigned written() const
+	{
+		return written_;
+	}
+
+private:
+	const iovec *iov_;
+	const iovec *end_;
+	size_t pos_;
+	unsigned written_;
+};
+
+unsigned Encoder::encode( const iovec *iov, int iovcnt, const iovec *out, int outcnt )
+{
+	BASE64_PROBE1( encoder__encodev__entry, iovcnt );
+	if ( !status_ )
+	{
+		BASE64_PROBE3( encoder__encodev__return, 0, 0, false );
+		return 0;
+	}
+	IovecWriter writer( out, outcnt );
+	unsigned total = 0;
+	for( int i = 0; i < iovcnt; i++ )
+	{
+		const char *data = static_cast<const char*>( iov[i].iov_base );
+		unsigned size = iov[i].iov_len;
+		encoded_bytes_ += size;
+		total += size;
+		while( size )
+		{
+			size_t space;
+			char *p = writer.buffer( space );
+			if ( n_ == 0 && size >= 3 && space >= 4 )
+			{
+				// Whole triplets are encoded straight into the output buffer
+				unsigned len = std::min<size_t>( size / 3, space / 4 ) * 3;
+				base64::encode_<Binary>( data, len, p );
+				writer.advance( len / 3 * 4 );
+				data += len;
+				size -= len;
+				continue;
+			}
+			// Triplet split between input segments or output buffers
+			for( ; n_ < 3 && size; n_++, size--, data++ )
+			{
+				chunk_[n_] = *data;
+			}
+			if ( n_ < 3 )
+			{
+				break;
+			}
+			char quad[4];
+			encode_triplet( chunk_, quad );
+			if ( !writer.write( quad, 4 ) )
+			{
+				status_ = false;
+				BASE64_PROBE3( encoder__encodev__return, total, 0, false );
+				return 0;
+			}
+			n_ = 0;
+		}
+	}
+	BASE64_PROBE3( encoder__encodev__return, total, writer.written(), true );
+	return writer.written();
 }
 
+unsigned Encoder::finalize( const iovec *out, int outcnt )
+{
+	std::string leftover = finalize();
+	IovecWriter writer( out, outcnt );
+	if ( !writer.write( leftover.data(), leftover.size() ) )
+	{
+		status_ = false;
+		return 0;
+	}
+	return writer.written();
+}
+#endif
+
 
 Decoder::Decoder() :
 	status_( true ),
@@ -423,70 +1272,163 @@ Decoder& Decoder::reset()
 
 bool Decoder::decode( const char *data, unsigned size, std::vector<char> &out )
 {
-	return decode_( data, size, out, 1, &append );
+	BASE64_PROBE1( decoder__decode__entry, size );
+	size_t base = out.size();
+	bool status = decode_<Binary>( data, size, out );
+	BASE64_PROBE4( decoder__decode__return, size, out.size() - base, status, status ? size : error_offset_( data, size ) );
+	return status;
 }
 
 bool Decoder::decode_hex( const char *data, unsigned size, std::vector<char> &out )
 {
-	return decode_( data, size, out, 2, &append_hex );
+	BASE64_PROBE1( decoder__decode__entry, size );
+	size_t base = out.size();
+	bool status = decode_<Hex>( data, size, out );
+	BASE64_PROBE4( decoder__decode__return, size, out.size() - base, status, status ? size : error_offset_( data, size ) );
+	return status;
 }
 
-bool Decoder::decode_( const char *data, unsigned size, std::vector<char> &out, unsigned n, void (*append)( std::vector<char>&, char ) )
+#ifndef _WIN32
+bool Decoder::decode( const iovec *iov, int iovcnt, const iovec *out, int outcnt, unsigned &written )
 {
+	BASE64_PROBE1( decoder__decodev__entry, iovcnt );
+	written = 0;
 	if ( !status_ )
 	{
+		BASE64_PROBE4( decoder__decodev__return, 0, 0, false, 0 );
 		return false;
 	}
-	unsigned pos = 0;
-	while( true )
+	IovecWriter writer( out, outcnt );
+	bool padded = false;
+	unsigned total = 0;
+	int i = 0;
+	for( ; i < iovcnt && status_ && !padded; i++ )
 	{
-		for( ; n_ < 4 && pos < size; n_++, pos++ )
+		const char *data = static_cast<const char*>( iov[i].iov_base );
+		unsigned size = iov[i].iov_len;
+		total += size;
+		unsigned pos = 0, len;
+		char bytes[3];
+		bool bulk = true;
+		while( !padded )
 		{
-			if ( valid_base64_characters_[(unsigned)data[pos]] || data[pos] == '=' )
+			size_t space;
+			char *p = writer.buffer( space );
+			unsigned groups = std::min<size_t>( ( size - pos ) / 4, space / 3 );
+			if ( bulk && n_ == 0 && groups )
 			{
-				chunk_[n_] = data[pos];
-				continue;
+				// Whole groups are decoded straight into the output buffer
+				len = decode_buffer_<Binary>( data + pos, groups * 4, p, groups * 3 );
+				if ( len )
+				{
+					writer.advance( len );
+					pos += groups * 4;
+					padded = done_ = len < groups * 3;
+					continue;
+				}
+				// Invalid character or padding inside the run, located group by group below
+				bulk = false;
 			}
-			status_ = false;
-			break;
-		}
-		if ( n_ < 4 )
-		{
-			break;
-		}
-		if ( chunk_[0] == '=' || chunk_[1] == '=' )
-		{
-			status_ = false;
-			break;
-		}
-		char buf[] = {
-			(char)index_by_char( chunk_[0] ),
-			(char)index_by_char( chunk_[1] ),
-			(char)index_by_char( chunk_[2] ),
-			(char)index_by_char( chunk_[3] )
-		};
-		append( out, ( buf[0] << 2 ) + ( ( buf[1] & 0x30 ) >> 4 ) );
-		append( out, ( ( buf[1] & 0x0f ) << 4 ) + ( ( buf[2] & 0x3c ) >> 2 ) );
-		append( out, ( ( buf[2] & 0x03 ) << 6 ) + ( buf[3] & 0x3f ) );
-		n_ = 0;
-		if ( chunk_[2] == '=' )
-		{
-			if ( chunk_[3] == '=' )
+			// Group split between input segments or output buffers
+			if ( !next_( data, size, pos, bytes, len ) )
 			{
-				out.resize( out.size() - 2 * n );
-				done_ = true;
 				break;
 			}
-			else
+			if ( !writer.write( bytes, len ) )
 			{
 				status_ = false;
 				break;
 			}
+			padded = len < 3;
+		}
+	}
+	written = writer.written();
+	BASE64_PROBE4( decoder__decodev__return, total, written, status_, status_ ? total :
+		total - iov[i - 1].iov_len + error_offset_( static_cast<const char*>( iov[i - 1].iov_base ), iov[i - 1].iov_len ) );
+	return status_;
+}
+#endif
+
+bool Decoder::next_( const char *data, unsigned size, unsigned &pos, char bytes[3], unsigned &len )
+{
+	for( ; n_ < 4 && pos < size; n_++, pos++ )
+	{
+		if ( !valid_base64_characters_[(unsigned char)data[pos]] && data[pos] != '=' )
+		{
+			status_ = false;
+			return false;
+		}
+		chunk_[n_] = data[pos];
+	}
+	if ( n_ < 4 )
+	{
+		return false;
+	}
+	len = decode_last_quad( chunk_, bytes );
+	if ( !len )
+	{
+		status_ = false;
+		return false;
+	}
+	n_ = 0;
+	if ( len < 3 )
+	{
+		done_ = true;
+	}
+	return true;
+}
+
+template<typename Format>
+static inline void append_( std::vector<char> &out, const char *bytes, unsigned len )
+{
+	char buf[3 * Format::width];
+	char *p = buf;
+	for( unsigned i = 0; i < len; i++ )
+	{
+		p = Format::write( p, bytes[i] );
+	}
+	out.insert( out.end(), buf, p );
+}
+
+template<typename Format>
+bool Decoder::decode_( const char *data, unsigned size, std::vector<char> &out )
+{
+	if ( !status_ )
+	{
+		return false;
+	}
+	unsigned pos = 0, len;
+	char bytes[3];
+	if ( n_ )
+	{
+		// Complete group started by previous chunk
+		if ( !next_( data, size, pos, bytes, len ) )
+		{
+			return status_;
+		}
+		append_<Format>( out, bytes, len );
+		if ( len < 3 )
+		{
+			return status_;
 		}
-		else if ( chunk_[3] == '=' )
+	}
+	// Complete groups without padding are decoded directly from input
+	size_t base = out.size();
+	out.resize( base + ( size - pos ) / 4 * 3 * Format::width );
+	char *p = out.data() + base;
+	for( ; size - pos >= 4 && decode_quad( data + pos, bytes ); pos += 4 )
+	{
+		p = Format::write( p, bytes[0] );
+		p = Format::write( p, bytes[1] );
+		p = Format::write( p, bytes[2] );
+	}
+	out.resize( p - out.data() );
+	// Padding, leftover and errors
+	while( next_( data, size, pos, bytes, len ) )
+	{
+		append_<Format>( out, bytes, len );
+		if ( len < 3 )
 		{
-			out.resize( out.size() - n );
-			done_ = true;
 			break;
 		}
 	}
@@ -0,0 +1,280 @@
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "base64_cache.hpp"
+
+namespace base64
+{
+
+/**
+ * Cache shard: entries live in a ring of slots swept by the CLOCK hand,
+ * index maps input hash to slots (hash collisions are resolved by full compare).
+ */
+class EncodeCacheShard
+{
+public:
+	EncodeCacheShard() :
+		max_memory_( 0 ),
+		memory_( 0 ),
+		hand_( 0 ),
+		hits_( 0 ),
+		misses_( 0 ),
+		evictions_( 0 )
+	{
+	}
+
+	void limit( size_t max_memory )
+	{
+		max_memory_ = max_memory;
+	}
+
+	EncodeCache::Buffer find( unsigned long long hash, const char *data, unsigned size )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		EncodeCache::Buffer result = find_( hash, data, size );
+		if ( result )
+		{
+			hits_++;
+		}
+		else
+		{
+			misses_++;
+		}
+		return result;
+	}
+
+	/* Inserts encoded buffer, returns the cached one, if other thread has inserted it first */
+	EncodeCache::Buffer insert( unsigned long long hash, const char *data, unsigned size, const EncodeCache::Buffer &value )
+	{
+		size_t need = footprint_( size, value->size() );
+		if ( need > max_memory_ )
+		{
+			return value;
+		}
+		std::lock_guard<std::mutex> lock( mutex_ );
+		EncodeCache::Buffer cached = find_( hash, data, size );
+		if ( cached )
+		{
+			return cached;
+		}
+		while( memory_ + need > max_memory_ )
+		{
+			evict_();
+		}
+		unsigned slot;
+		if ( free_.empty() )
+		{
+			slot = slots_.size();
+			slots_.push_back( Entry() );
+		}
+		else
+		{
+			slot = free_.back();
+			free_.pop_back();
+		}
+		Entry &entry = slots_[slot];
+		entry.hash = hash;
+		entry.key.assign( data, size );
+		entry.value = value;
+		entry.referenced = false;
+		index_.insert( std::make_pair( hash, slot ) );
+		memory_ += need;
+		return value;
+	}
+
+	void stats( EncodeCache::Stats &stats )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stats.hits += hits_;
+		stats.misses += misses_;
+		stats.evictions += evictions_;
+		stats.entries += index_.size();
+		stats.memory += memory_;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		slots_.clear();
+		free_.clear();
+		index_.clear();
+		memory_ = 0;
+		hand_ = 0;
+	}
+
+private:
+	struct Entry
+	{
+		unsigned long long hash;
+		std::string key;
+		EncodeCache::Buffer value;
+		bool referenced;
+	};
+
+	std::mutex mutex_;
+	std::vector<Entry> slots_;
+	std::vector<unsigned> free_;
+	std::unordered_multimap<unsigned long long, unsigned> index_;
+	size_t max_memory_;
+	size_t memory_;
+	unsigned hand_;
+	unsigned long long hits_;
+	unsigned long long misses_;
+	unsigned long long evictions_;
+	// Keeps shards on separate cache lines
+	char pad_[64];
+
+	static size_t footprint_( unsigned size, size_t encoded )
+	{
+		return size + encoded + sizeof( Entry ) + 64;
+	}
+
+	EncodeCache::Buffer find_( unsigned long long hash, const char *data, unsigned size )
+	{
+		auto range = index_.equal_range( hash );
+		for( auto it = range.first; it != range.second; ++it )
+		{
+			Entry &entry = slots_[it->second];
+			if ( entry.key.size() == size && memcmp( entry.key.data(), data, size ) == 0 )
+			{
+				entry.referenced = true;
+				return entry.value;
+			}
+		}
+		return EncodeCache::Buffer();
+	}
+
+	// Advances the CLOCK hand to the first entry not referenced since the last sweep and removes it.
+	void evict_()
+	{
+		while( true )
+		{
+			if ( hand_ >= slots_.size() )
+			{
+				hand_ = 0;
+			}
+			Entry &entry = slots_[hand_++];
+			if ( !entry.value )
+			{
+				continue;
+			}
+			if ( entry.referenced )
+			{
+				entry.referenced = false;
+				continue;
+			}
+			auto range = index_.equal_range( entry.hash );
+			for( auto it = range.first; it != range.second; ++it )
+			{
+				if ( it->second == hand_ - 1 )
+				{
+					index_.erase( it );
+					break;
+				}
+			}
+			memory_ -= footprint_( entry.key.size(), entry.value->size() );
+			entry.key = std::string();
+			entry.value.reset();
+			free_.push_back( hand_ - 1 );
+			evictions_++;
+			return;
+		}
+	}
+};
+
+
+static inline unsigned long long rotl( unsigned long long x, unsigned r )
+{
+	return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline unsigned long long read64( const char *p )
+{
+	unsigned long long v;
+	memcpy( &v, p, sizeof( v ) );
+	return v;
+}
+
+/* Multiplicative hash over four independent lanes, so that hashing is much cheaper than encoding */
+static unsigned long long hash( const char *data, unsigned size )
+{
+	const unsigned long long k1 = 0x9e3779b185ebca87ull, k2 = 0xc2b2ae3d27d4eb4full;
+	unsigned long long h[4] = { k1 + k2, k2, 0, 0 - k1 };
+	const char *end = data + size;
+	for( ; end - data >= 32; data += 32 )
+	{
+		for( unsigned i = 0; i < 4; i++ )
+		{
+			h[i] = rotl( h[i] + read64( data + i * 8 ) * k2, 31 ) * k1;
+		}
+	}
+	unsigned long long result = rotl( h[0], 1 ) + rotl( h[1], 7 ) + rotl( h[2], 12 ) + rotl( h[3], 18 ) + size;
+	for( ; end - data >= 8; data += 8 )
+	{
+		result = rotl( result ^ ( rotl( read64( data ) * k2, 31 ) * k1 ), 27 ) * k1;
+	}
+	unsigned long long tail = 0;
+	if ( data < end )
+	{
+		memcpy( &tail, data, end - data );
+	}
+	result = rotl( result ^ ( tail * k1 ), 23 ) * k2;
+	result ^= result >> 29;
+	result *= k1;
+	result ^= result >> 32;
+	return result;
+}
+
+
+EncodeCache::EncodeCache( size_t max_memory, unsigned shards ) :
+	shard_count_( shards ? shards : 16 )
+{
+	shards_.reset( new EncodeCacheShard[shard_count_] );
+	for( unsigned i = 0; i < shard_count_; i++ )
+	{
+		shards_[i].limit( max_memory / shard_count_ );
+	}
+}
+
+EncodeCache::~EncodeCache()
+{
+}
+
+EncodeCache::Buffer EncodeCache::encode( const char *data, unsigned size )
+{
+	unsigned long long h = hash( data, size );
+	EncodeCacheShard &shard = shards_[( h >> 32 ) % shard_count_];
+	Buffer cached = shard.find( h, data, size );
+	if ( cached )
+	{
+		return cached;
+	}
+	// Encoded outside of the lock
+	std::shared_ptr<std::string> value = std::make_shared<std::string>( encoded_size( size ), '\0' );
+	if ( size )
+	{
+		base64::encode( data, size, &( *value )[0], value->size() );
+	}
+	return shard.insert( h, data, size, value );
+}
+
+EncodeCache::Stats EncodeCache::stats() const
+{
+	Stats result = Stats();
+	for( unsigned i = 0; i < shard_count_; i++ )
+	{
+		shards_[i].stats( result );
+	}
+	return result;
+}
+
+void EncodeCache::clear()
+{
+	for( unsigned i = 0; i < shard_count_; i++ )
+	{
+		shards_[i].clear();
+	}
+}
+
+} // namespace base64
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "base64_parallel.hpp"
+#include "waiter.hpp"
+
+namespace base64
+{
+
+/**
+ * Ordered block pipeline shared by parallel encoder and decoder.
+ * Blocks live in a fixed ring of slots. The feeding thread fills slots and publishes them
+ * through the submitted_ counter, workers claim them through the claimed_ counter (lock-free),
+ * and completed slots are passed to the output callback strictly in submission order.
+ * Idle threads are parked by the waiter.
+ */
+class ParallelCodec
+{
+public:
+	typedef bool (*Process)( const char *data, unsigned size, bool last, std::vector<char> &out, unsigned &out_size );
+
+	ParallelCodec( ParallelOutput output, Process process, unsigned threads, unsigned block_size, unsigned queue_depth ) :
+		output_( output ),
+		process_( process ),
+		block_size_( block_size ),
+		submitted_( 0 ),
+		claimed_( 0 ),
+		stop_( false ),
+		delivered_( 0 ),
+		filling_( false ),
+		status_( true )
+	{
+		if ( threads == 0 )
+		{
+			threads = std::max( std::thread::hardware_concurrency(), 1u );
+		}
+		depth_ = queue_depth ? queue_depth : threads * 2;
+		jobs_.reset( new Job[depth_] );
+		for( unsigned i = 0; i < depth_; i++ )
+		{
+			jobs_[i].in.reserve( block_size_ );
+		}
+		for( unsigned i = 0; i < threads; i++ )
+		{
+			threads_.push_back( std::thread( &ParallelCodec::worker_, this ) );
+		}
+	}
+
+	~ParallelCodec()
+	{
+		status_ = false;
+		drain_();
+		stop_ = true;
+		waiter_.notify_all();
+		for( auto &t : threads_ )
+		{
+			t.join();
+		}
+	}
+
+	bool status() const
+	{
+		return status_;
+	}
+
+	void fail()
+	{
+		status_ = false;
+	}
+
+	void reset()
+	{
+		status_ = false;
+		drain_();
+		filling_ = false;
+		status_ = true;
+	}
+
+	bool write( const char *data, unsigned size )
+	{
+		while( status_ && size )
+		{
+			Job &job = fill_();
+			unsigned n = std::min<unsigned>( size, block_size_ - job.in.size() );
+			job.in.insert( job.in.end(), data, data + n );
+			data += n;
+			size -= n;
+			if ( job.in.size() == block_size_ )
+			{
+				submit_( false );
+			}
+		}
+		deliver_();
+		return status_;
+	}
+
+	bool finalize()
+	{
+		if ( status_ )
+		{
+			fill_();
+			submit_( true );
+		}
+		drain_();
+		return status_;
+	}
+
+private:
+	struct Job
+	{
+		Job() :
+			done( false ),
+			last( false ),
+			status( false ),
+			out_size( 0 )
+		{
+		}
+
+		std::atomic<bool> done;
+		bool last;
+		bool status;
+		unsigned out_size;
+		std::vector<char> in;
+		std::vector<char> out;
+	};
+
+	ParallelOutput output_;
+	Process process_;
+	unsigned block_size_;
+	unsigned depth_;
+	std::unique_ptr<Job[]> jobs_;
+	std::vector<std::thread> threads_;
+
+	// Counters are padded apart to keep them on separate cache lines
+	char pad0_[64];
+	std::atomic<unsigned long long> submitted_;
+	char pad1_[64];
+	std::atomic<unsigned long long> claimed_;
+	char pad2_[64];
+	std::atomic<bool> stop_;
+	Waiter waiter_;
+	char pad3_[64];
+
+	// Feeding thread state
+	unsigned long long delivered_;
+	bool filling_;
+	bool status_;
+
+	void worker_()
+	{
+		unsigned long long n = claimed_;
+		while( true )
+		{
+			if ( n < submitted_ )
+			{
+				if ( !claimed_.compare_exchange_weak( n, n + 1 ) )
+				{
+					continue;
+				}
+				Job &job = jobs_[n % depth_];
+				job.status = process_( job.in.data(), job.in.size(), job.last, job.out, job.out_size );
+				job.done = true;
+				waiter_.notify();
+				n = claimed_;
+				continue;
+			}
+			if ( stop_ )
+			{
+				break;
+			}
+			waiter_.wait( [this, &n]() { n = claimed_; return stop_ || n < submitted_; } );
+		}
+	}
+
+	// Returns the slot being filled, waiting for a free one if the ring is full.
+	Job& fill_()
+	{
+		if ( !filling_ )
+		{
+			while( submitted_ - delivered_ == depth_ )
+			{
+				Job &oldest = jobs_[delivered_ % depth_];
+				waiter_.wait( [&oldest]() { return oldest.done.load(); } );
+				deliver_();
+			}
+			jobs_[submitted_ % depth_].in.clear();
+			filling_ = true;
+		}
+		return jobs_[submitted_ % depth_];
+	}
+
+	void submit_( bool last )
+	{
+		jobs_[submitted_ % depth_].last = last;
+		filling_ = false;
+		submitted_++;
+		waiter_.notify();
+	}
+
+	// Passes completed blocks to the output callback in order.
+	void deliver_()
+	{
+		while( delivered_ < submitted_ )
+		{
+			Job &job = jobs_[delivered_ % depth_];
+			if ( !job.done )
+			{
+				break;
+			}
+			if ( !job.status )
+			{
+				status_ = false;
+			}
+			if ( status_ && job.out_size )
+			{
+				output_( job.out.data(), job.out_size );
+			}
+			job.done = false;
+			delivered_++;
+		}
+	}
+
+	void drain_()
+	{
+		while( delivered_ < submitted_ )
+		{
+			Job &oldest = jobs_[delivered_ % depth_];
+			waiter_.wait( [&oldest]() { return oldest.done.load(); } );
+			deliver_();
+		}
+	}
+};
+
+
+// Blocks other than the last one are multiple of 3 bytes, so that only the last one is padded
+static bool encode_block( const char *data, unsigned size, bool, std::vector<char> &out, unsigned &out_size )
+{
+	if ( out.size() < encoded_size( size ) )
+	{
+		out.resize( encoded_size( size ) );
+	}
+	out_size = encode( data, size, out.data(), out.size() );
+	return true;
+}
+
+// Blocks other than the last one are multiple of 4 characters, padding is checked by ParallelDecoder::decode()
+static bool decode_block( const char *data, unsigned size, bool, std::vector<char> &out, unsigned &out_size )
+{
+	if ( out.size() < size / 4 * 3 )
+	{
+		out.resize( size / 4 * 3 );
+	}
+	out_size = size ? decode( data, size, out.data(), out.size() ) : 0;
+	return out_size || !size;
+}
+
+
+ParallelEncoder::ParallelEncoder( ParallelOutput output, unsigned threads, unsigned block_size, unsigned queue_depth ) :
+	codec_( new ParallelCodec( output, &encode_block, threads, std::max( block_size / 3, 1u ) * 3, queue_depth ) )
+{
+}
+
+ParallelEncoder::~ParallelEncoder()
+{
+}
+
+ParallelEncoder::operator bool() const
+{
+	return codec_->status();
+}
+
+ParallelEncoder& ParallelEncoder::reset()
+{
+	codec_->reset();
+	return *this;
+}
+
+bool ParallelEncoder::encode( const char *data, unsigned size )
+{
+	return codec_->write( data, size );
+}
+
+bool ParallelEncoder::finalize()
+{
+	return codec_->finalize();
+}
+
+
+ParallelDecoder::ParallelDecoder( ParallelOutput output, unsigned threads, unsigned block_size, unsigned queue_depth ) :
+	codec_( new ParallelCodec( output, &decode_block, threads, std::max( block_size / 4, 1u ) * 4, queue_depth ) ),
+	padded_( false )
+{
+}
+
+ParallelDecoder::~ParallelDecoder()
+{
+}
+
+ParallelDecoder::operator bool() const
+{
+	return codec_->status();
+}
+
+ParallelDecoder& ParallelDecoder::reset()
+{
+	codec_->reset();
+	padded_ = false;
+	return *this;
+}
+
+bool ParallelDecoder::decode( const char *data, unsigned size )
+{
+	// Blocks are decoded independently, so padding must be checked across the whole stream:
+	// only padding characters may follow the first one.
+	const char *eq = padded_ ? data : static_cast<const char*>( memchr( data, '=', size ) );
+	if ( eq )
+	{
+		padded_ = true;
+		for( const char *end = data + size; eq < end; eq++ )
+		{
+			if ( *eq != '=' )
+			{
+				codec_->fail();
+				return false;
+			}
+		}
+	}
+	return codec_->write( data, size );
+}
+
+bool ParallelDecoder::finalize()
+{
+	return codec_->finalize();
+}
+
+} // namespace base64
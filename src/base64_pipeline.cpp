@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cstring>
+#include "base64_pipeline.hpp"
+#include "waiter.hpp"
+
+namespace base64
+{
+
+#ifndef _WIN32
+DecodePipeline::DecodePipeline( unsigned slabs, unsigned slab_size ) :
+	slab_count_( std::max( slabs, 1u ) ),
+	slab_size_( std::max( slab_size, 3u ) ),
+	slabs_( new char[(size_t)slab_count_ * slab_size_] ),
+	sizes_( new unsigned[slab_count_] ),
+	fill_( 0 ),
+	released_cache_( 0 ),
+	padded_( false ),
+	published_( 0 ),
+	released_( 0 ),
+	finished_( false ),
+	status_( true ),
+	waiter_( new Waiter )
+{
+}
+
+DecodePipeline::~DecodePipeline()
+{
+}
+
+DecodePipeline::operator bool() const
+{
+	return status_;
+}
+
+DecodePipeline& DecodePipeline::reset()
+{
+	decoder_.reset();
+	fill_ = 0;
+	released_cache_ = 0;
+	padded_ = false;
+	published_ = 0;
+	released_ = 0;
+	finished_ = false;
+	status_ = true;
+	return *this;
+}
+
+bool DecodePipeline::decode( const char *data, unsigned size )
+{
+	// Decoder starts a new group after padding at a chunk boundary, so that padding is checked here:
+	// only padding characters may follow the first one.
+	const char *eq = padded_ ? data : static_cast<const char*>( memchr( data, '=', size ) );
+	if ( eq )
+	{
+		padded_ = true;
+		for( const char *end = data + size; eq < end; eq++ )
+		{
+			if ( *eq != '=' )
+			{
+				status_ = false;
+				return false;
+			}
+		}
+	}
+	while( status_ && size )
+	{
+		if ( fill_ == 0 && published_ - released_cache_ == slab_count_ )
+		{
+			// Ring is full: wait for the consumer
+			waiter_->wait( [this]() { return published_ - released_ < slab_count_; } );
+			released_cache_ = released_;
+		}
+		unsigned space = slab_size_ - fill_;
+		// Decoder keeps up to 3 characters between calls, so that input is limited to space / 3 groups
+		unsigned n = std::min( size, space / 3 * 4 );
+		iovec in = { const_cast<char*>( data ), n };
+		iovec out = { slabs_.get() + ( published_ % slab_count_ ) * slab_size_ + fill_, space };
+		unsigned written;
+		if ( !decoder_.decode( &in, 1, &out, 1, written ) )
+		{
+			status_ = false;
+		}
+		fill_ += written;
+		data += n;
+		size -= n;
+		if ( slab_size_ - fill_ < 3 )
+		{
+			publish_();
+		}
+	}
+	return status_;
+}
+
+bool DecodePipeline::finish()
+{
+	if ( fill_ )
+	{
+		publish_();
+	}
+	if ( !decoder_.done() )
+	{
+		status_ = false;
+	}
+	finished_ = true;
+	waiter_->notify();
+	return status_;
+}
+
+bool DecodePipeline::acquire( const char *&data, unsigned &size )
+{
+	unsigned long long n = released_;
+	waiter_->wait( [this, n]() { return n < published_ || finished_; } );
+	if ( n == published_ )
+	{
+		return false;
+	}
+	data = slabs_.get() + ( n % slab_count_ ) * slab_size_;
+	size = sizes_[n % slab_count_];
+	return true;
+}
+
+void DecodePipeline::release()
+{
+	released_++;
+	waiter_->notify();
+}
+
+void DecodePipeline::publish_()
+{
+	sizes_[published_ % slab_count_] = fill_;
+	fill_ = 0;
+	published_++;
+	waiter_->notify();
+}
+#endif
+
+} // namespace base64
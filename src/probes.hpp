@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * USDT static probes (SystemTap SDT v3 notes, as produced by sys/sdt.h), enabled with BASE64_USDT.
+ * Each probe is a single NOP instruction and an ELF note in .note.stapsdt section,
+ * which tracers (bpftrace, perf, bcc, systemtap) use to find probe address and argument locations.
+ * All arguments are passed as 64-bit unsigned integers. Provider name is "base64".
+ */
+#if defined(BASE64_USDT) && defined(__GNUC__) && defined(__ELF__) && ( defined(__x86_64__) || defined(__aarch64__) )
+
+#if defined(__x86_64__)
+#define BASE64_PROBE_ARG_( x ) "nor"( (unsigned long long)( x ) )
+#else
+#define BASE64_PROBE_ARG_( x ) "r"( (unsigned long long)( x ) )
+#endif
+
+#define BASE64_PROBE_( name, args, ... ) \
+	__asm__ __volatile__ ( \
+		"990: nop\n" \
+		".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+		".balign 4\n" \
+		".4byte 992f-991f, 994f-993f, 3\n" \
+		"991: .asciz \"stapsdt\"\n" \
+		"992: .balign 4\n" \
+		"993: .8byte 990b\n" \
+		".8byte _.stapsdt.base\n" \
+		".8byte 0\n" \
+		".asciz \"base64\"\n" \
+		".asciz \"" #name "\"\n" \
+		".asciz \"" args "\"\n" \
+		"994: .balign 4\n" \
+		".popsection\n" \
+		".ifndef _.stapsdt.base\n" \
+		".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+		".weak _.stapsdt.base\n" \
+		".hidden _.stapsdt.base\n" \
+		"_.stapsdt.base: .space 1\n" \
+		".size _.stapsdt.base, 1\n" \
+		".popsection\n" \
+		".endif\n" \
+		:: __VA_ARGS__ )
+
+#define BASE64_PROBE1( name, a1 ) \
+	BASE64_PROBE_( name, "8@%0", BASE64_PROBE_ARG_( a1 ) )
+#define BASE64_PROBE2( name, a1, a2 ) \
+	BASE64_PROBE_( name, "8@%0 8@%1", BASE64_PROBE_ARG_( a1 ), BASE64_PROBE_ARG_( a2 ) )
+#define BASE64_PROBE3( name, a1, a2, a3 ) \
+	BASE64_PROBE_( name, "8@%0 8@%1 8@%2", BASE64_PROBE_ARG_( a1 ), BASE64_PROBE_ARG_( a2 ), BASE64_PROBE_ARG_( a3 ) )
+#define BASE64_PROBE4( name, a1, a2, a3, a4 ) \
+	BASE64_PROBE_( name, "8@%0 8@%1 8@%2 8@%3", BASE64_PROBE_ARG_( a1 ), BASE64_PROBE_ARG_( a2 ), \
+		BASE64_PROBE_ARG_( a3 ), BASE64_PROBE_ARG_( a4 ) )
+
+#else
+
+// Arguments are not evaluated, sizeof only keeps them referenced
+#define BASE64_PROBE1( name, a1 ) do { (void)sizeof( a1 ); } while( 0 )
+#define BASE64_PROBE2( name, a1, a2 ) do { (void)sizeof( a1 ); (void)sizeof( a2 ); } while( 0 )
+#define BASE64_PROBE3( name, a1, a2, a3 ) do { (void)sizeof( a1 ); (void)sizeof( a2 ); (void)sizeof( a3 ); } while( 0 )
+#define BASE64_PROBE4( name, a1, a2, a3, a4 ) \
+	do { (void)sizeof( a1 ); (void)sizeof( a2 ); (void)sizeof( a3 ); (void)sizeof( a4 ); } while( 0 )
+
+#endif
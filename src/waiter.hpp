@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace base64
+{
+
+/**
+ * Spin-then-park wait for state shared through atomics (used by parallel coders and decoding pipeline).
+ * Waiting thread re-checks the predicate while yielding for a while, then parks on the condition variable.
+ * Notifying thread takes the mutex only when some thread is parked, so that the fast path is lock-free.
+ * State must be updated before notify() with sequentially consistent atomics, so that either
+ * the parked thread sees it or the notifying thread sees the sleeper.
+ */
+class Waiter
+{
+public:
+	Waiter() :
+		sleepers_( 0 )
+	{
+	}
+
+	template<typename Predicate>
+	void wait( Predicate ready )
+	{
+		for( unsigned i = 0; i < 64; i++ )
+		{
+			if ( ready() )
+			{
+				return;
+			}
+			std::this_thread::yield();
+		}
+		sleepers_++;
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			cv_.wait( lock, ready );
+		}
+		sleepers_--;
+	}
+
+	void notify()
+	{
+		if ( sleepers_ )
+		{
+			notify_all();
+		}
+	}
+
+	/* Wakes parked threads unconditionally */
+	void notify_all()
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		cv_.notify_all();
+	}
+
+private:
+	std::atomic<unsigned> sleepers_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+};
+
+} // namespace base64
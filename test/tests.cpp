@@ -1,6 +1,12 @@
 #include <CppUTest/CommandLineTestRunner.h>
 #include <CppUTest/TestHarness.h>
 #include "base64.hpp"
+#include "base64_cache.hpp"
+#include "base64_coro.hpp"
+#include "base64_parallel.hpp"
+#include "base64_pipeline.hpp"
+#include <cstdint>
+#include <thread>
 
 using namespace base64;
 
@@ -10,6 +16,17 @@ int main( int argc, char** argv)
 	return CommandLineTestRunner::RunAllTests( argc, argv );
 }
 
+// Binary test data without repeating patterns
+static std::string test_input( unsigned size = 100000 )
+{
+	std::string input( size, '\0' );
+	for( unsigned i = 0; i < input.size(); i++ )
+	{
+		input[i] = (char)( i * 7919 + ( i >> 8 ) );
+	}
+	return input;
+}
+
 TEST_GROUP(Base64Group)
 {
 	void setup()
@@ -86,6 +103,14 @@ TEST(Base64Group, EncodeHex)
 	b64 = encode_hex( input.c_str(), input.length() );
 	STRCMP_EQUAL( "", b64.c_str() );
 	CHECK( 0 == b64.size() );
+
+	char buf[20];
+	input = "576974682050616464696e6773"; // With Paddings
+	LONGS_EQUAL( 20, encode_hex( input.c_str(), input.length(), buf, sizeof( buf ) ) );
+	STRNCMP_EQUAL( "V2l0aCBQYWRkaW5ncw==", buf, 20 );
+	LONGS_EQUAL( 0, encode_hex( input.c_str(), input.length(), buf, 19 ) );
+	LONGS_EQUAL( 0, encode_hex( input.c_str(), input.length() - 1, buf, sizeof( buf ) ) );
+	LONGS_EQUAL( 0, encode_hex( "12x456", 6, buf, sizeof( buf ) ) );
 }
 
 TEST(Base64Group, Decode)
@@ -146,7 +171,7 @@ TEST(Base64Group, Combined)
 {
 	std::string input( "Hello\nWorld" );
 	auto b64 = encode( input.c_str(), input.length() );
-	CHECK( input == decode( b64 ).data() );
+	CHECK( input == decode_str( b64 ) );
 }
 
 TEST(Base64Group, Validate)
@@ -160,6 +185,167 @@ TEST(Base64Group, Validate)
 	CHECK( !validate( "====" ) );
 }
 
+TEST(Base64Group, DecodeOutput)
+{
+	std::string input( "V2l0aCBQYWRkaW5ncw==" );
+	std::string str;
+	CHECK( decode( input.c_str(), input.size(), str ) );
+	STRCMP_EQUAL( "With Paddings", str.c_str() );
+	CHECK( decode_hex( input, str ) );
+	STRCMP_EQUAL( "576974682050616464696e6773", str.c_str() );
+	CHECK_FALSE( decode( "AB=C", str ) );
+	CHECK( str.empty() );
+
+	char buf[16];
+	LONGS_EQUAL( 13, decode( input.c_str(), input.size(), buf, 13 ) );
+	STRNCMP_EQUAL( "With Paddings", buf, 13 );
+	LONGS_EQUAL( 0, decode( input.c_str(), input.size(), buf, 12 ) );
+	LONGS_EQUAL( 6, decode_hex( "EjRWVQ==", 4, buf, sizeof( buf ) ) );
+	STRNCMP_EQUAL( "123456", buf, 6 );
+
+	// Slice of a larger buffer, not NUL-terminated
+	const char *slice = "VGVzdCBzdHJpbmc=VGVz";
+	CHECK( validate( slice, 16 ) );
+	LONGS_EQUAL( 11, decode( slice, 16, buf, sizeof( buf ) ) );
+	STRNCMP_EQUAL( "Test string", buf, 11 );
+}
+
+#ifdef BASE64_CXX17
+TEST(Base64Group, StringView)
+{
+	std::string_view input( "VGVzdCBzdHJpbmc=VGVz" );
+	std::string_view slice = input.substr( 0, 16 );
+	CHECK( validate( slice ) );
+	CHECK_FALSE( validate( input.substr( 0, 15 ) ) );
+	CHECK( decoded_size( slice ) == 11 );
+	auto bytes = decode( slice );
+	STRNCMP_EQUAL( "Test string", bytes.data(), bytes.size() );
+	std::string str;
+	CHECK( decode( input.substr( 16 ), str ) );
+	STRCMP_EQUAL( "Tes", str.c_str() );
+	char buf[12];
+	LONGS_EQUAL( 11, decode( slice, buf, sizeof( buf ) ) );
+	STRNCMP_EQUAL( "Test string", buf, 11 );
+}
+#endif
+
+TEST(Base64Group, ShortInput)
+{
+	std::string input;
+	for( unsigned size = 0; size <= 100; size++ )
+	{
+		// Byte by byte encoding does not use block kernels
+		Encoder e;
+		std::string expected;
+		for( char ch : input )
+		{
+			expected += e.encode( &ch, 1 );
+		}
+		expected += e.finalize();
+		auto b64 = encode( input.c_str(), input.size() );
+		CHECK( expected == b64 );
+		CHECK( input.empty() || validate( b64 ) );
+		CHECK( input == decode_str( b64 ) );
+		if ( b64.size() > 4 )
+		{
+			b64[b64.size() - 5] = '.';
+			CHECK_FALSE( validate( b64 ) );
+			CHECK( decode( b64 ).empty() );
+		}
+		input += (char)( size * 97 + 13 );
+	}
+
+	// Invalid input with decoded_size() of 0 must not be written into the output buffer
+	std::string invalid = "=" + std::string( 23, 'A' );
+	char guard = '#';
+	LONGS_EQUAL( 0, decode( invalid.data(), invalid.size(), &guard, 0 ) );
+	CHECK_EQUAL( '#', guard );
+}
+
+TEST(Base64Group, LargeBuffer)
+{
+	std::string input = test_input();
+	std::vector<char> buf( encoded_size( input.size() ) + 32 );
+	// Caller-supplied output at every offset from 16-byte boundary
+	char *aligned = buf.data() + ( 16 - reinterpret_cast<uintptr_t>( buf.data() ) % 16 ) % 16;
+	for( unsigned size : { 1000u, 1001u, 99999u } )
+	{
+		large_buffer_mode( 0 );
+		std::string expected = encode( input.data(), size );
+		large_buffer_mode( 1000, true );
+		std::string b64 = encode( input.data(), size );
+		CHECK( expected == b64 );
+		for( unsigned offset = 0; offset < 16; offset++ )
+		{
+			char *out = aligned + offset;
+			out[b64.size()] = '#';
+			CHECK_EQUAL( b64.size(), encode( input.data(), size, out, b64.size() ) );
+			CHECK( b64 == std::string( out, b64.size() ) );
+			CHECK_EQUAL( '#', out[b64.size()] );
+			CHECK_EQUAL( size, decode( b64.data(), b64.size(), out, size ) );
+			CHECK( input.substr( 0, size ) == std::string( out, size ) );
+		}
+		std::string decoded;
+		CHECK( decode( b64, decoded ) );
+		CHECK( input.substr( 0, size ) == decoded );
+		b64[b64.size() / 2] = '@';
+		CHECK_FALSE( decode( b64, decoded ) );
+	}
+	// Invalid input must not be streamed into a buffer too small for it
+	large_buffer_mode( 64 );
+	std::string invalid = "=" + std::string( 4095, 'A' );
+	aligned[0] = '#';
+	LONGS_EQUAL( 0, decode( invalid.data(), invalid.size(), aligned, 0 ) );
+	CHECK_EQUAL( '#', aligned[0] );
+	large_buffer_mode( 0 );
+}
+
+TEST(Base64Group, Scan)
+{
+	std::string icon( 1000, '\0' );
+	for( unsigned i = 0; i < icon.size(); i++ )
+	{
+		icon[i] = (char)( i * 31 );
+	}
+	std::string html = "<img src=\"data:image/png;base64," + encode( icon.data(), icon.size() ) + "\">"
+		"<a href=\"data:text/plain;charset=utf-8;base64,VGVzdCBzdHJpbmc=\">"
+		"<a href=\"data:text/plain;base64,V@\"><a href=\"data:text/plain,VGVz\">"
+		"url(data:;base64,VGVzdCBzdHJpbmc)";
+	std::vector<char> arena( 1, 'x' );
+	std::vector<Span> spans;
+	CHECK_EQUAL( 3, scan_data_uris( html.data(), html.size(), arena, spans ) );
+	CHECK_EQUAL( 3, spans.size() );
+	STRCMP_EQUAL( "image/png", html.substr( spans[0].mime_begin, spans[0].mime_end - spans[0].mime_begin ).c_str() );
+	CHECK( encode( icon.data(), icon.size() ) == html.substr( spans[0].begin, spans[0].end - spans[0].begin ) );
+	CHECK_EQUAL( 1, spans[0].out_begin );
+	CHECK( icon == std::string( arena.data() + spans[0].out_begin, arena.data() + spans[0].out_end ) );
+	STRCMP_EQUAL( "text/plain", html.substr( spans[1].mime_begin, spans[1].mime_end - spans[1].mime_begin ).c_str() );
+	STRCMP_EQUAL( "VGVzdCBzdHJpbmc=", html.substr( spans[1].begin, spans[1].end - spans[1].begin ).c_str() );
+	STRCMP_EQUAL( "Test string", std::string( arena.data() + spans[1].out_begin, arena.data() + spans[1].out_end ).c_str() );
+	CHECK_EQUAL( spans[2].mime_begin, spans[2].mime_end );
+	STRCMP_EQUAL( "Test string", std::string( arena.data() + spans[2].out_begin, arena.data() + spans[2].out_end ).c_str() );
+	CHECK_EQUAL( spans[2].out_end, arena.size() );
+
+	std::string text = "key=VGVz key=@ key=VGVzdA==key=";
+	spans.clear();
+	arena.clear();
+	CHECK_EQUAL( 2, scan_prefixed( text.data(), text.size(), "key=", arena, spans ) );
+	STRCMP_EQUAL( "TesTest", std::string( arena.begin(), arena.end() ).c_str() );
+	STRCMP_EQUAL( "VGVzdA==", text.substr( spans[1].begin, spans[1].end - spans[1].begin ).c_str() );
+
+	std::string json = "{\"VGVzdCBzdHJpbmc=\": \"VGVzdCBzdHJpbmc=\", \"a\": [\"VGVz\\\"dCBzdHJpbmc=\", \"VGVzdCBzdHJpbmc@\", "
+		"\"VGVzdA==\", \"" + encode( icon.data(), icon.size() ) + "\"], \"b\": \"VGVzdCBzdHJpbmc\"}";
+	spans.clear();
+	arena.clear();
+	CHECK_EQUAL( 4, scan_json( json.data(), json.size(), arena, spans, 8 ) );
+	STRCMP_EQUAL( "Test string", std::string( arena.data() + spans[0].out_begin, arena.data() + spans[0].out_end ).c_str() );
+	CHECK_EQUAL( 22, spans[0].begin );
+	STRCMP_EQUAL( "Test", std::string( arena.data() + spans[1].out_begin, arena.data() + spans[1].out_end ).c_str() );
+	CHECK( icon == std::string( arena.data() + spans[2].out_begin, arena.data() + spans[2].out_end ) );
+	STRCMP_EQUAL( "Test string", std::string( arena.data() + spans[3].out_begin, arena.data() + spans[3].out_end ).c_str() );
+	CHECK_EQUAL( 0, scan_json( json.data(), json.size(), arena, spans, 2000 ) );
+}
+
 TEST(Base64Group, Encoder)
 {
 	Encoder e;
@@ -223,3 +409,434 @@ TEST(Base64Group, DecoderHex)
 	CHECK( d );
 	CHECK( d.done() );
 }
+
+// Splits buffer into segments of varying size (including ones, which split triplets and groups)
+static std::vector<iovec> split_iovec( char *data, size_t size, unsigned modulus )
+{
+	std::vector<iovec> result;
+	for( size_t pos = 0, n = 1; pos < size; pos += n, n = n * 7 % modulus )
+	{
+		iovec v = { data + pos, std::min<size_t>( n, size - pos ) };
+		result.push_back( v );
+	}
+	return result;
+}
+
+TEST(Base64Group, EncoderIovec)
+{
+	Encoder e;
+	char in1[] = "Te", in2[] = "st s", in3[] = "tring";
+	iovec in[] = { { in1, 2 }, { in2, 4 }, { in3, 5 } };
+	char out1[5], out2[7], out3[16];
+	iovec out[] = { { out1, sizeof( out1 ) }, { out2, sizeof( out2 ) }, { out3, sizeof( out3 ) } };
+	unsigned n = e.encode( in, 3, out, 3 );
+	CHECK( e );
+	LONGS_EQUAL( 12, n );
+	STRNCMP_EQUAL( "VGVzd", out1, 5 );
+	STRNCMP_EQUAL( "CBzdHJp", out2, 7 );
+	iovec tail[] = { { out3, sizeof( out3 ) } };
+	n = e.finalize( tail, 1 );
+	CHECK( e );
+	LONGS_EQUAL( 4, n );
+	STRNCMP_EQUAL( "bmc=", out3, 4 );
+
+	e.reset();
+	iovec small[] = { { out1, 3 } };
+	LONGS_EQUAL( 0, e.encode( in, 3, small, 1 ) );
+	CHECK_FALSE( e );
+
+	std::string input = test_input();
+	std::string encoded( encoded_size( input.size() ), '\0' );
+	std::vector<iovec> segments = split_iovec( &input[0], input.size(), 4099 );
+	std::vector<iovec> buffers = split_iovec( &encoded[0], encoded.size(), 1031 );
+	e.reset();
+	n = e.encode( segments.data(), segments.size(), buffers.data(), buffers.size() );
+	CHECK( e );
+	LONGS_EQUAL( encoded.size() - 4, n );
+	iovec last[] = { { &encoded[n], 4 } };
+	LONGS_EQUAL( 4, e.finalize( last, 1 ) );
+	CHECK( encode( input.data(), input.size() ) == encoded );
+}
+
+TEST(Base64Group, DecoderIovec)
+{
+	Decoder d;
+	char in1[] = "VGVzdC", in2[] = "Bzd", in3[] = "HJpbmc=";
+	iovec in[] = { { in1, 6 }, { in2, 3 }, { in3, 7 } };
+	char out1[4], out2[8];
+	iovec out[] = { { out1, sizeof( out1 ) }, { out2, sizeof( out2 ) } };
+	unsigned written;
+	CHECK( d.decode( in, 3, out, 2, written ) );
+	CHECK( d.done() );
+	LONGS_EQUAL( 11, written );
+	STRNCMP_EQUAL( "Test", out1, 4 );
+	STRNCMP_EQUAL( " string", out2, 7 );
+
+	d.reset();
+	iovec small[] = { { out1, sizeof( out1 ) } };
+	CHECK_FALSE( d.decode( in, 3, small, 1, written ) );
+	CHECK_FALSE( d );
+
+	d.reset();
+	char bad[] = "VGV@";
+	iovec in_bad[] = { { bad, 4 } };
+	CHECK_FALSE( d.decode( in_bad, 1, out, 2, written ) );
+	CHECK_FALSE( d );
+
+	std::string input = test_input();
+	std::string encoded = encode( input.data(), input.size() );
+	std::string decoded( input.size(), '\0' );
+	std::vector<iovec> segments = split_iovec( &encoded[0], encoded.size(), 4099 );
+	std::vector<iovec> buffers = split_iovec( &decoded[0], decoded.size(), 1031 );
+	d.reset();
+	CHECK( d.decode( segments.data(), segments.size(), buffers.data(), buffers.size(), written ) );
+	CHECK( d.done() );
+	LONGS_EQUAL( input.size(), written );
+	CHECK( input == decoded );
+
+	d.reset();
+	decoded.assign( decoded.size(), '\0' );
+	encoded[50001] = '@';
+	CHECK_FALSE( d.decode( segments.data(), segments.size(), buffers.data(), buffers.size(), written ) );
+	CHECK( written <= 50001 / 4 * 3 );
+	CHECK( input.substr( 0, written ) == decoded.substr( 0, written ) );
+}
+
+
+TEST_GROUP(ParallelGroup)
+{
+	std::string input;
+
+	void setup()
+	{
+		input = test_input();
+	}
+	void teardown()
+	{
+	}
+};
+
+TEST(ParallelGroup, Encoder)
+{
+	std::string result;
+	ParallelEncoder e( [&result]( const char *data, unsigned size ) { result.append( data, size ); }, 4, 1000, 3 );
+	CHECK( e );
+	for( unsigned pos = 0, n = 1; pos < input.size(); pos += n, n = n * 3 % 4099 )
+	{
+		CHECK( e.encode( input.data() + pos, std::min<unsigned>( n, input.size() - pos ) ) );
+	}
+	CHECK( e.finalize() );
+	CHECK( encode( input.data(), input.size() ) == result );
+
+	result.clear();
+	e.reset();
+	std::string chunk( "Test string" );
+	CHECK( e.encode( chunk.data(), chunk.size() ) );
+	CHECK( e.finalize() );
+	STRCMP_EQUAL( "VGVzdCBzdHJpbmc=", result.c_str() );
+}
+
+TEST(ParallelGroup, Decoder)
+{
+	std::string encoded = encode( input.data(), input.size() - 1 );
+	std::string result;
+	ParallelDecoder d( [&result]( const char *data, unsigned size ) { result.append( data, size ); }, 4, 1000, 3 );
+	CHECK( d );
+	for( unsigned pos = 0, n = 1; pos < encoded.size(); pos += n, n = n * 3 % 4099 )
+	{
+		CHECK( d.decode( encoded.data() + pos, std::min<unsigned>( n, encoded.size() - pos ) ) );
+	}
+	CHECK( d.finalize() );
+	CHECK( input.substr( 0, input.size() - 1 ) == result );
+
+	d.reset();
+	encoded[50000] = '@';
+	d.decode( encoded.data(), encoded.size() );
+	CHECK_FALSE( d.finalize() );
+	CHECK_FALSE( d );
+
+	d.reset();
+	std::string chunk( "VGVzdCBzdHJpbmc=" );
+	CHECK( d.decode( chunk.data(), chunk.size() ) );
+	CHECK_FALSE( d.decode( chunk.data(), chunk.size() ) );
+	CHECK_FALSE( d );
+
+	d.reset();
+	chunk = "VGVzdCBzdHJpbm";
+	CHECK( d.decode( chunk.data(), chunk.size() ) );
+	CHECK_FALSE( d.finalize() );
+}
+
+
+TEST_GROUP(CacheGroup)
+{
+	void setup()
+	{
+	}
+	void teardown()
+	{
+	}
+};
+
+TEST(CacheGroup, Encode)
+{
+	EncodeCache cache( 1024 * 1024, 4 );
+	std::string input( "Test string" );
+	EncodeCache::Buffer first = cache.encode( input.data(), input.size() );
+	STRCMP_EQUAL( "VGVzdCBzdHJpbmc=", first->c_str() );
+	EncodeCache::Buffer second = cache.encode( input.data(), input.size() );
+	CHECK( first == second );
+	STRCMP_EQUAL( "", cache.encode( "", 0 )->c_str() );
+
+	// Same length and hash lane content must still be compared in full
+	std::string other( "Test strinG" );
+	STRCMP_EQUAL( "VGVzdCBzdHJpbkc=", cache.encode( other.data(), other.size() )->c_str() );
+
+	EncodeCache::Stats stats = cache.stats();
+	CHECK_EQUAL( 1, stats.hits );
+	CHECK_EQUAL( 3, stats.misses );
+	CHECK_EQUAL( 3, stats.entries );
+
+	cache.clear();
+	CHECK_EQUAL( 0, cache.stats().entries );
+	CHECK_EQUAL( 0, cache.stats().memory );
+	STRCMP_EQUAL( "VGVzdCBzdHJpbmc=", first->c_str() );
+}
+
+TEST(CacheGroup, Eviction)
+{
+	EncodeCache cache( 8 * 1024, 1 );
+	std::string input( 1000, 'x' );
+	EncodeCache::Buffer hot = cache.encode( input.data(), input.size() );
+	for( unsigned i = 0; i < 100; i++ )
+	{
+		input[0] = (char)i;
+		cache.encode( input.data(), input.size() );
+		input[0] = 'x';
+		CHECK( cache.encode( input.data(), input.size() ) == hot );
+	}
+	EncodeCache::Stats stats = cache.stats();
+	CHECK( stats.memory <= 8 * 1024 );
+	CHECK( stats.evictions > 0 );
+	CHECK_EQUAL( 100, stats.hits );
+
+	// Input larger than the limit is encoded, but not cached
+	std::string large( 10000, 'y' );
+	CHECK( encode( large.data(), large.size() ) == *cache.encode( large.data(), large.size() ) );
+	CHECK( cache.stats().memory <= 8 * 1024 );
+}
+
+TEST(CacheGroup, Threads)
+{
+	EncodeCache cache( 64 * 1024, 4 );
+	std::vector<std::string> inputs;
+	for( unsigned i = 0; i < 64; i++ )
+	{
+		inputs.push_back( std::string( i * 37 % 1000, (char)i ) );
+	}
+	std::vector<std::thread> threads;
+	std::vector<bool> results( 4, true );
+	for( unsigned t = 0; t < 4; t++ )
+	{
+		threads.push_back( std::thread( [&, t]() {
+			for( unsigned i = 0; i < 2000; i++ )
+			{
+				const std::string &input = inputs[( i * ( t + 1 ) ) % inputs.size()];
+				if ( *cache.encode( input.data(), input.size() ) != encode( input.data(), input.size() ) )
+				{
+					results[t] = false;
+				}
+			}
+		} ) );
+	}
+	for( auto &t : threads )
+	{
+		t.join();
+	}
+	for( bool result : results )
+	{
+		CHECK( result );
+	}
+	CHECK( cache.stats().memory <= 64 * 1024 );
+}
+
+
+TEST_GROUP(PipelineGroup)
+{
+	std::string input;
+
+	void setup()
+	{
+		input = test_input();
+	}
+	void teardown()
+	{
+	}
+
+	// Decodes encoded in chunks of varying size on a producer thread, returns data collected by the consumer
+	std::string run( DecodePipeline &pipeline, const std::string &encoded, bool &status )
+	{
+		std::string result;
+		std::thread consumer( [&]() {
+			const char *data;
+			unsigned size;
+			while( pipeline.acquire( data, size ) )
+			{
+				result.append( data, size );
+				pipeline.release();
+			}
+		} );
+		for( unsigned pos = 0, n = 1; pos < encoded.size(); pos += n, n = n * 3 % 4099 )
+		{
+			pipeline.decode( encoded.data() + pos, std::min<unsigned>( n, encoded.size() - pos ) );
+		}
+		status = pipeline.finish();
+		consumer.join();
+		return result;
+	}
+};
+
+TEST(PipelineGroup, Decode)
+{
+	std::string encoded = encode( input.data(), input.size() - 1 );
+	bool status;
+	DecodePipeline pipeline( 4, 1000 );
+	CHECK( input.substr( 0, input.size() - 1 ) == run( pipeline, encoded, status ) );
+	CHECK( status );
+	CHECK( pipeline );
+
+	// Slabs smaller than a group of 4 characters
+	DecodePipeline small( 2, 1 );
+	CHECK( input.substr( 0, input.size() - 1 ) == run( small, encoded, status ) );
+	CHECK( status );
+
+	pipeline.reset();
+	STRCMP_EQUAL( "Test string", run( pipeline, "VGVzdCBzdHJpbmc=", status ).c_str() );
+	CHECK( status );
+}
+
+TEST(PipelineGroup, Errors)
+{
+	std::string encoded = encode( input.data(), input.size() );
+	encoded[50000] = '@';
+	bool status;
+	DecodePipeline pipeline( 4, 1000 );
+	CHECK( run( pipeline, encoded, status ).size() <= 50000 / 4 * 3 );
+	CHECK_FALSE( status );
+	CHECK_FALSE( pipeline );
+
+	pipeline.reset();
+	run( pipeline, "VGVzdCBzdHJpbm", status );
+	CHECK_FALSE( status );
+
+	// Only padding may follow padding, in the same chunk or in the next ones
+	pipeline.reset();
+	run( pipeline, "QQ==QUJD", status );
+	CHECK_FALSE( status );
+	pipeline.reset();
+	CHECK_FALSE( pipeline.decode( "QQ==QUJD", 8 ) );
+	CHECK_FALSE( pipeline.finish() );
+	pipeline.reset();
+	CHECK( pipeline.decode( "QQ=", 3 ) );
+	CHECK( pipeline.decode( "=", 1 ) );
+	CHECK( pipeline.finish() );
+}
+
+
+#if __cplusplus >= 202002L
+TEST_GROUP(CoroutineGroup)
+{
+	AsyncLoop loop;
+	std::string input;
+	size_t pos;
+	unsigned n;
+
+	void setup()
+	{
+		input = test_input();
+	}
+	void teardown()
+	{
+	}
+
+	// Returns chunks of varying size, each after a round trip through the loop
+	auto source( const std::string &data )
+	{
+		pos = 0;
+		n = 1;
+		return [this, &data]() -> AsyncTask<std::string_view> {
+			co_await loop.schedule();
+			std::string_view chunk( data.data() + pos, std::min<size_t>( n, data.size() - pos ) );
+			pos += chunk.size();
+			n = n * 3 % 4099;
+			co_return chunk;
+		};
+	}
+
+	static AsyncTask<std::string> collect( AsyncGenerator<std::string_view> blocks, unsigned max_block )
+	{
+		std::string result;
+		while( const std::string_view *block = co_await blocks.next() )
+		{
+			if ( block->size() > max_block )
+			{
+				co_return std::string();
+			}
+			result.append( *block );
+		}
+		co_return result;
+	}
+};
+
+TEST(CoroutineGroup, Encode)
+{
+	for( unsigned size : { 0u, 1u, 2u, 1000u } )
+	{
+		std::string data = input.substr( 0, input.size() - size );
+		CHECK( encode( data.data(), data.size() ) == loop.run( collect( encode_async( source( data ), 1000 ), 1000 ) ) );
+	}
+	std::string data( "Test string" );
+	STRCMP_EQUAL( "VGVzdCBzdHJpbmc=", loop.run( collect( encode_async( source( data ), 4 ), 4 ) ).c_str() );
+}
+
+TEST(CoroutineGroup, Decode)
+{
+	bool status = false;
+	for( unsigned size : { 0u, 1u, 2u } )
+	{
+		std::string data = input.substr( 0, input.size() - size );
+		std::string encoded = encode( data.data(), data.size() );
+		CHECK( data == loop.run( collect( decode_async( source( encoded ), status, 999 ), 999 ) ) );
+		CHECK( status );
+	}
+	std::string encoded( "VGVzdCBzdHJpbmc=" );
+	STRCMP_EQUAL( "Test string", loop.run( collect( decode_async( source( encoded ), status, 1 ), 3 ) ).c_str() );
+	CHECK( status );
+
+	// Group completed by the next chunk fills the whole block, more groups follow in the same chunk
+	const std::string_view chunks[] = { "V", "GVzdCBzdHJpbmc=", "" };
+	for( unsigned block_size : { 3u, 5u } )
+	{
+		const std::string_view *chunk = chunks;
+		auto next = [this, &chunk]() -> AsyncTask<std::string_view> {
+			co_await loop.schedule();
+			co_return *chunk++;
+		};
+		STRCMP_EQUAL( "Test string", loop.run( collect( decode_async( next, status, block_size ), 3 ) ).c_str() );
+		CHECK( status );
+	}
+
+	encoded = encode( input.data(), input.size() );
+	encoded[50000] = '@';
+	loop.run( collect( decode_async( source( encoded ), status ), 64 * 1024 ) );
+	CHECK_FALSE( status );
+
+	encoded = "VGVzdCBzdHJpbmc=VGVz";
+	loop.run( collect( decode_async( source( encoded ), status ), 64 * 1024 ) );
+	CHECK_FALSE( status );
+
+	encoded = "VGVzdCBzdHJpbm";
+	loop.run( collect( decode_async( source( encoded ), status ), 64 * 1024 ) );
+	CHECK_FALSE( status );
+}
+#endif